@@ -0,0 +1,52 @@
+"""Check of a reduced-yield run against a full-yield run of the same source:
+
+    python analysis/check_yield.py events_full.crdh events_k10.crdh
+
+yield_check.mac writes both files. The mean SiPM photon count and its
+variance, corrected with full_yield_moments(), must agree within "sigmas"
+combined standard errors; the exit status is 1 if either does not.
+"""
+
+import argparse
+import sys
+
+import numpy as np
+
+from crd_hits import compare_yield_runs, read_events
+
+
+def check(full, scaled, sigmas=3.):
+    """Prints the comparison and returns True if the runs agree."""
+    result = compare_yield_runs(full, scaled)
+    passed = True
+    for name, index, errors in (("mean", 0, result["error"]),
+                                ("variance", 1, result["variance_error"])):
+        full_value, scaled_value = result["full"][index], result["scaled"][index]
+        error = np.hypot(*errors)
+        pull = (scaled_value - full_value) / error if error > 0. else 0.
+        ok = abs(pull) <= sigmas
+        passed = passed and ok
+        print(f"{name:8s}  full {full_value:12.4g}  scaled {scaled_value:12.4g}"
+              f"  +- {error:10.3g}  pull {pull:+6.2f}  {'ok' if ok else 'FAIL'}")
+    return passed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("full", help="events.crdh of the full-yield run")
+    parser.add_argument("scaled", help="events.crdh of the yieldFactor run")
+    parser.add_argument("--sigmas", type=float, default=3.,
+                        help="largest accepted difference, in standard errors")
+    args = parser.parse_args()
+
+    full, scaled = read_events(args.full), read_events(args.scaled)
+    if len(full["photons"]) < 2 or len(scaled["photons"]) < 2:
+        print("Need at least two events in each run.")
+        return 1
+    print(f"{len(full['photons'])} full-yield events, {len(scaled['photons'])} with"
+          f" yieldFactor {scaled['yield_factor'][0]:g}")
+    return 0 if check(full, scaled, args.sigmas) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,325 @@
+"""Reader for the events.crdh, hits_<type>.crdh, sipm_histograms.crdh,
+waveforms.crdh and deposits.crdh files of a run.
+
+Layouts are documented in include/EventSummary.hh, include/HitWriter.hh,
+include/HistogramWriter.hh, include/WaveformWriter.hh and
+include/DepositWriter.hh.
+Columns come back as numpy arrays without any text parsing:
+
+    from crd_hits import read_events, read_hits
+    events = read_events("events.crdh")
+    events["photons"], events["edep"], events["triggered"]
+    events["charge"], events["signal_time"]   # digitized SiPM signal, p.e. and ns
+    sipm = read_hits("hits_sipm.crdh")       # with /crd/output/hits true
+    sipm["time"], sipm["event"], sipm["thread"]  # ns, event ID, G4 thread
+    hist = read_histograms("sipm_histograms.crdh")  # /crd/sipm/readout histogram
+    hist["counts"][i]                         # dense arrival times of row i
+    wave = read_waveforms("waveforms.crdh")   # /crd/sipm/wave/enable true
+    wave["amplitude"][i]                      # mV, one sample per wave["period"] ns
+    dep = read_deposits("deposits.crdh")      # /crd/twopass/mode record
+    np.savetxt("replay.txt", dep["event"][dep["edep"] > 1.], fmt="%d")  # /crd/twopass/events
+    compare_yield_runs(read_events("events_full.crdh"),   # yield_check.mac,
+                       read_events("events_k10.crdh"))    # or analysis/check_yield.py
+
+Units are mm, ns and eV; "channel" is the copy number of the volume hit.
+"""
+
+import os
+
+import numpy as np
+
+MAGIC = b"CRDHITS2"
+HIT_TYPES = {0: "sipm", 1: "mc", 2: "step"}
+FLOAT_COLUMNS = ("x", "y", "z", "time", "energy")
+INT_COLUMNS = ("channel", "track", "event")
+
+_HEADER = np.dtype([("magic", "S8"), ("type", "<i4"), ("reserved", "<i4"),
+                    ("rows", "<i8"), ("groups", "<i8")])
+_GROUP = np.dtype([("rows", "<i4"), ("thread", "<i4")])
+
+
+def read_hits(path):
+    """Return a dict of column name -> numpy array, plus "type"."""
+    data = np.memmap(path, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data, dtype=_HEADER, count=1)[0]
+    if header["magic"] != MAGIC:
+        raise ValueError(f"{path} is not a CRD hit file")
+
+    total = int(header["rows"])
+    columns = {name: np.empty(total, dtype=np.float32) for name in FLOAT_COLUMNS}
+    for name in INT_COLUMNS:
+        columns[name] = np.empty(total, dtype=np.int32)
+    columns["thread"] = np.empty(total, dtype=np.int32)
+
+    offset = _HEADER.itemsize
+    row = 0
+    for _ in range(int(header["groups"])):
+        group = np.frombuffer(data, dtype=_GROUP, count=1, offset=offset)[0]
+        n = int(group["rows"])
+        offset += _GROUP.itemsize
+        for name in FLOAT_COLUMNS:
+            columns[name][row:row + n] = np.frombuffer(data, dtype="<f4", count=n, offset=offset)
+            offset += 4 * n
+        for name in INT_COLUMNS:
+            columns[name][row:row + n] = np.frombuffer(data, dtype="<i4", count=n, offset=offset)
+            offset += 4 * n
+        columns["thread"][row:row + n] = group["thread"]
+        row += n
+
+    if row != total:
+        raise ValueError(f"{path} is truncated: {row} of {total} rows")
+    columns["type"] = HIT_TYPES.get(int(header["type"]), "unknown")
+    return columns
+
+
+EVENT_MAGIC = b"CRDEVT05"
+EVENT_COLUMNS = (("event", "<i4"), ("thread", "<i4"), ("energy", "<f4"),
+                 ("dir_x", "<f4"), ("dir_y", "<f4"), ("dir_z", "<f4"),
+                 ("entry_x", "<f4"), ("entry_y", "<f4"), ("entry_z", "<f4"),
+                 ("edep", "<f4"), ("weight", "<f4"), ("photons", "<i4"), ("tracked", "<f4"),
+                 ("estimate", "<f4"),
+                 ("yield_factor", "<f4"),
+                 ("first_time", "<f4"), ("median_time", "<f4"),
+                 ("charge", "<f4"), ("fired_cells", "<i4"), ("signal_time", "<f4"),
+                 ("triggered", "u1"))
+
+
+def read_events(path):
+    """Per-event summary: dict of column name -> numpy array.
+
+    Energies in MeV, positions in mm, times in ns; entry point and times are
+    NaN for events that never reached the scintillator or saw no photon.
+    "charge" is the digitized SiPM charge in p.e. "tracked" is the fraction
+    of the optical photons tracked (/crd/optical/early/) and "estimate" the
+    unbiased full detected count, equal to photons unless stopped early. "yield_factor" is k of a reduced-yield run
+    (/crd/optical/governor/yieldFactor), see full_yield_moments().
+    """
+    data = np.memmap(path, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data, dtype=_HEADER, count=1)[0]
+    if header["magic"] != EVENT_MAGIC:
+        raise ValueError(f"{path} is not a CRD event summary file")
+
+    parts = {name: [] for name, _ in EVENT_COLUMNS}
+    offset = _HEADER.itemsize
+    for _ in range(int(header["groups"])):
+        n = int(np.frombuffer(data, dtype=_GROUP, count=1, offset=offset)[0]["rows"])
+        offset += _GROUP.itemsize
+        for name, dtype in EVENT_COLUMNS:
+            column = np.frombuffer(data, dtype=dtype, count=n, offset=offset)
+            parts[name].append(column)
+            offset += column.nbytes
+
+    columns = {name: np.concatenate(chunks) if chunks else np.empty(0, dtype=dtype)
+               for (name, dtype), chunks in zip(EVENT_COLUMNS, parts.values())}
+    columns["triggered"] = columns["triggered"].astype(bool)
+    return columns
+
+
+HISTOGRAM_MAGIC = b"CRDTHS01"
+HISTOGRAM_COLUMNS = ("event", "thread", "photons", "overflow", "entries")
+
+_HISTOGRAM_HEADER = np.dtype([("magic", "S8"), ("bin_width", "<f4"), ("bins", "<i4"),
+                              ("rows", "<i8"), ("groups", "<i8")])
+
+
+def read_histograms(path):
+    """Per-event SiPM arrival-time histograms.
+
+    "event", "thread", "photons" and "overflow" (photons outside the window)
+    have one entry per row; "counts" is a dense (rows, bins) int32 array of
+    photons per bin of width "bin_width" ns from t = 0.
+    """
+    data = np.memmap(path, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data, dtype=_HISTOGRAM_HEADER, count=1)[0]
+    if header["magic"] != HISTOGRAM_MAGIC:
+        raise ValueError(f"{path} is not a CRD time histogram file")
+
+    total, bins = int(header["rows"]), int(header["bins"])
+    columns = {name: np.empty(total, dtype=np.int32) for name in HISTOGRAM_COLUMNS}
+    counts = np.zeros((total, bins), dtype=np.int32)
+
+    offset = _HISTOGRAM_HEADER.itemsize
+    row = 0
+    for _ in range(int(header["groups"])):
+        n, m = (int(v) for v in np.frombuffer(data, dtype="<i4", count=2, offset=offset))
+        offset += 8
+        for name in HISTOGRAM_COLUMNS:
+            columns[name][row:row + n] = np.frombuffer(data, dtype="<i4", count=n, offset=offset)
+            offset += 4 * n
+        bin_index = np.frombuffer(data, dtype="<i4", count=m, offset=offset)
+        bin_count = np.frombuffer(data, dtype="<i4", count=m, offset=offset + 4 * m)
+        offset += 8 * m
+        rows = row + np.repeat(np.arange(n), columns["entries"][row:row + n])
+        counts[rows, bin_index] = bin_count
+        row += n
+
+    if row != total:
+        raise ValueError(f"{path} is truncated: {row} of {total} rows")
+    del columns["entries"]
+    columns["counts"] = counts
+    columns["bin_width"] = float(header["bin_width"])
+    return columns
+
+
+WAVEFORM_MAGIC = b"CRDWAV01"
+
+_WAVEFORM_HEADER = np.dtype([("magic", "S8"), ("period", "<f4"), ("samples", "<i4"),
+                             ("rows", "<i8"), ("groups", "<i8")])
+
+
+def read_waveforms(path):
+    """Sampled SiPM waveforms: "event", "thread", "amplitude" (rows, samples)
+    in mV and the sample spacing "period" in ns."""
+    data = np.memmap(path, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data, dtype=_WAVEFORM_HEADER, count=1)[0]
+    if header["magic"] != WAVEFORM_MAGIC:
+        raise ValueError(f"{path} is not a CRD waveform file")
+
+    total, samples = int(header["rows"]), int(header["samples"])
+    event = np.empty(total, dtype=np.int32)
+    thread = np.empty(total, dtype=np.int32)
+    amplitude = np.empty((total, samples), dtype=np.float32)
+
+    offset = _WAVEFORM_HEADER.itemsize
+    row = 0
+    for _ in range(int(header["groups"])):
+        n = int(np.frombuffer(data, dtype=_GROUP, count=1, offset=offset)[0]["rows"])
+        offset += _GROUP.itemsize
+        event[row:row + n] = np.frombuffer(data, dtype="<i4", count=n, offset=offset)
+        thread[row:row + n] = np.frombuffer(data, dtype="<i4", count=n, offset=offset + 4 * n)
+        offset += 8 * n
+        amplitude[row:row + n] = np.frombuffer(
+            data, dtype="<f4", count=n * samples, offset=offset).reshape(n, samples)
+        offset += 4 * n * samples
+        row += n
+
+    if row != total:
+        raise ValueError(f"{path} is truncated: {row} of {total} rows")
+    return {"event": event, "thread": thread, "amplitude": amplitude,
+            "period": float(header["period"])}
+
+
+DEPOSIT_MAGIC = b"CRDDEP01"
+DEPOSIT_EVENT_COLUMNS = (("event", "<i4"), ("thread", "<i4"), ("deposits", "<i4"),
+                         ("weight", "<f4"), ("edep", "<f4"), ("primary_energy", "<f4"))
+DEPOSIT_COLUMNS = (("x", "<f4"), ("y", "<f4"), ("z", "<f4"), ("time", "<f4"),
+                   ("step_edep", "<f4"), ("pdg", "<i4"))
+
+
+def read_deposits(path):
+    """Scintillator energy deposits of a record pass, in MeV rather than eV.
+
+    "event", "thread", "deposits" (steps per event), "weight", "edep" and
+    "primary_energy" have one entry per event; "x", "y", "z", "time",
+    "step_edep", "pdg" and "deposit_event" (its event ID) one per step.
+    """
+    data = np.memmap(path, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data, dtype=_HEADER, count=1)[0]
+    if header["magic"] != DEPOSIT_MAGIC:
+        raise ValueError(f"{path} is not a CRD deposit file")
+
+    groups = []
+    offset = _HEADER.itemsize
+    for _ in range(int(header["groups"])):
+        n, m = (int(v) for v in np.frombuffer(data, dtype="<i4", count=2, offset=offset))
+        offset += 8
+        group = {}
+        for columns, count in ((DEPOSIT_EVENT_COLUMNS, n), (DEPOSIT_COLUMNS, m)):
+            for name, dtype in columns:
+                group[name] = np.frombuffer(data, dtype=dtype, count=count, offset=offset)
+                offset += 4 * count
+        groups.append(group)
+
+    columns = {name: np.concatenate([g[name] for g in groups]) if groups
+               else np.empty(0, dtype=dtype)
+               for name, dtype in DEPOSIT_EVENT_COLUMNS + DEPOSIT_COLUMNS}
+    if len(columns["event"]) != int(header["rows"]):
+        raise ValueError(f"{path} is truncated: {len(columns['event'])} of "
+                         f"{int(header['rows'])} events")
+    columns["deposit_event"] = np.repeat(columns["event"], columns["deposits"])
+    return columns
+
+
+def read_threshold_scan(path):
+    """Bench data like CR-Binning/data.csv: (voltage, events above it)."""
+    scan = np.genfromtxt(path, delimiter=",", names=True)
+    return scan["voltage"], scan["counts"]
+
+
+def threshold_counts(events, voltages, volts_per_pe, weighted=True):
+    """Simulated counterpart of a threshold scan: events whose SiPM charge,
+    at volts_per_pe volts per p.e., reaches each voltage."""
+    amplitude = np.nan_to_num(events["charge"]) * volts_per_pe
+    weights = events["weight"] if weighted else np.ones_like(amplitude)
+    return np.array([weights[amplitude >= v].sum() for v in np.asarray(voltages)])
+
+
+def _excess_per_photon(events):
+    """Variance a reduced-yield run adds per detected photon, see
+    full_yield_moments()."""
+    k = float(events["yield_factor"][0]) if len(events["photons"]) else 1.
+    f = k - np.floor(k)
+    return k - 1. + f * (1. - f) / k
+
+
+def full_yield_moments(events):
+    """Mean and variance of the SiPM photon count a full-yield run would give,
+    from a run with /crd/optical/governor/yieldFactor k.
+
+    Every detected photon there counts k times (as floor(k) copies, plus one
+    more with probability f = k - floor(k)), which keeps the mean but adds
+    (k - 1 + f(1 - f)/k) x mean to the variance; that is taken off again.
+    Exact for scintillation light without the roulette; Cerenkov photons,
+    counted once, make the correction slightly too large.
+    """
+    photons = events["photons"].astype(float)
+    mean = photons.mean()
+    return mean, photons.var(ddof=1) - _excess_per_photon(events) * mean
+
+
+def _variance_error(photons, excess):
+    """Standard error of var(photons) - excess x mean, from the sample's
+    central moments."""
+    n = len(photons)
+    centred = photons - photons.mean()
+    m2, m3, m4 = (np.mean(centred ** p) for p in (2, 3, 4))
+    var_of_var = (m4 - (n - 3.) / (n - 1.) * m2 ** 2) / n
+    return np.sqrt(max(0., var_of_var + excess ** 2 * m2 / n - 2. * excess * m3 / n))
+
+
+def compare_yield_runs(full, scaled):
+    """Validation of a reduced-yield run against a full-yield run of the same
+    source: {"full": (mean, variance), "scaled": (mean, variance)} of the
+    SiPM photon count, plus the standard errors of the means ("error") and
+    of the variances ("variance_error"). analysis/check_yield.py turns it
+    into a pass/fail check."""
+    n_full, n_scaled = len(full["photons"]), len(scaled["photons"])
+    full_photons = full["photons"].astype(float)
+    scaled_photons = scaled["photons"].astype(float)
+    mean, var = full_yield_moments(scaled)
+    return {"full": (full_photons.mean(), full_photons.var(ddof=1)),
+            "scaled": (mean, var),
+            "error": (np.sqrt(full_photons.var(ddof=1) / n_full),
+                      np.sqrt(scaled_photons.var(ddof=1) / n_scaled)),
+            "variance_error": (_variance_error(full_photons, 0.),
+                               _variance_error(scaled_photons, _excess_per_photon(scaled)))}
+
+
+def read_run(directory="."):
+    """Event summaries plus whichever hit, histogram, waveform and deposit
+    tables the run wrote."""
+    run = {"events": read_events(os.path.join(directory, "events.crdh"))}
+    for name in HIT_TYPES.values():
+        path = os.path.join(directory, f"hits_{name}.crdh")
+        if os.path.exists(path):
+            run[name] = read_hits(path)
+    path = os.path.join(directory, "sipm_histograms.crdh")
+    if os.path.exists(path):
+        run["histograms"] = read_histograms(path)
+    path = os.path.join(directory, "waveforms.crdh")
+    if os.path.exists(path):
+        run["waveforms"] = read_waveforms(path)
+    path = os.path.join(directory, "deposits.crdh")
+    if os.path.exists(path):
+        run["deposits"] = read_deposits(path)
+    return run
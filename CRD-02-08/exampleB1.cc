@@ -28,9 +28,15 @@
 /// \brief Main program of the B1 example
 
 #include "ActionInitialization.hh"
+#include "DataLogger.hh"
 #include "DetectorConstruction.hh"
+#include "Log.hh"
+#include "OutputThread.hh"
+#include "SiPMReadout.hh"
+#include "Trigger.hh"
 #include "QBBC.hh"
 #include "G4OpticalPhysics.hh"
+#include "G4FastSimulationPhysics.hh"
 
 #include "G4RunManagerFactory.hh"
 #include "G4SteppingVerbose.hh"
@@ -72,6 +78,12 @@ int main(int argc, char** argv)
   auto physicsList = new QBBC;
   auto opticalPhysics = new G4OpticalPhysics;
   physicsList->RegisterPhysics(opticalPhysics);
+  // Fast simulation for the charged particles the scintillator response may
+  // stop early: none with at-rest processes (decays, captures, annihilation)
+  auto fastSimulationPhysics = new G4FastSimulationPhysics;
+  for (auto name : {"e-", "proton", "deuteron", "alpha"})
+    fastSimulationPhysics->ActivateFastSimulation(name);
+  physicsList->RegisterPhysics(fastSimulationPhysics);
   physicsList->SetVerboseLevel(1);
   runManager->SetUserInitialization(physicsList);
 
@@ -87,6 +99,13 @@ int main(int argc, char** argv)
   // auto visManager = new G4VisExecutive("Quiet");
   visManager->Initialize();
 
+  // /crd/log/ verbosity, /crd/csv/, /crd/output/, /crd/sipm/ and /crd/trigger/ commands
+  Log::DefineCommands();
+  DefineCsvLoggerCommands();
+  OutputThread::Instance();
+  SiPMReadout::Instance();
+  Trigger::Instance();
+
   // Get the pointer to the User Interface manager
   auto UImanager = G4UImanager::GetUIpointer();
 
@@ -0,0 +1,108 @@
+// Bounded lock-free multi-producer queue
+// Yale Cubesat
+
+#ifndef B1BoundedQueue_h
+#define B1BoundedQueue_h 1
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace B1
+{
+
+/// Fixed-capacity ring buffer after D. Vyukov's bounded MPMC queue: each
+/// cell carries a sequence number, so producers claim a slot with one CAS
+/// and never wait on a lock. TryPush() fails instead of blocking when the
+/// queue is full; the caller decides how to back off. Capacity is rounded
+/// up to a power of two.
+
+template <typename T>
+class BoundedQueue
+{
+  public:
+    explicit BoundedQueue(std::size_t capacity)
+    {
+      std::size_t size = 2;
+      while (size < capacity) size <<= 1;
+      fMask = size - 1;
+      fCells.reset(new Cell[size]);
+      for (std::size_t i = 0; i < size; i++) fCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    std::size_t Capacity() const { return fMask + 1; }
+
+    bool TryPush(T&& value)
+    {
+      std::size_t pos = fTail.load(std::memory_order_relaxed);
+      for (;;) {
+        Cell& cell = fCells[pos & fMask];
+        std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+          if (fTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            cell.value = std::move(value);
+            cell.sequence.store(pos + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (diff < 0) {
+          return false;  // full
+        }
+        else {
+          pos = fTail.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    bool TryPop(T& value)
+    {
+      std::size_t pos = fHead.load(std::memory_order_relaxed);
+      for (;;) {
+        Cell& cell = fCells[pos & fMask];
+        std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (diff == 0) {
+          if (fHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+            value = std::move(cell.value);
+            cell.sequence.store(pos + fMask + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (diff < 0) {
+          return false;  // empty
+        }
+        else {
+          pos = fHead.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // Approximate, for monitoring only
+    std::size_t Size() const
+    {
+      std::size_t tail = fTail.load(std::memory_order_relaxed);
+      std::size_t head = fHead.load(std::memory_order_relaxed);
+      return tail > head ? tail - head : 0;
+    }
+
+  private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> fCells;
+    std::size_t fMask = 0;
+    alignas(64) std::atomic<std::size_t> fTail{0};
+    alignas(64) std::atomic<std::size_t> fHead{0};
+};
+
+}  // namespace B1
+
+#endif
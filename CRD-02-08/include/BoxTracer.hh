@@ -0,0 +1,190 @@
+// Batched optical photon transport in the box scintillator
+// Yale Cubesat
+
+#ifndef B1BoxTracer_h
+#define B1BoxTracer_h 1
+
+#include "OpticalGovernor.hh"
+
+#include "G4MaterialPropertyVector.hh"
+#include "G4ThreeVector.hh"
+#include "G4VAccumulable.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4GenericMessenger;
+class G4Track;
+
+namespace B1
+{
+
+class SiPMSD;
+
+/// Photons traced and their cost, and in check mode the SiPM counts of
+/// both transports, summed over the events of a run and merged on the
+/// master.
+
+class BoxTracerStats : public G4VAccumulable
+{
+  public:
+    BoxTracerStats() : G4VAccumulable("BoxTracer") {}
+    ~BoxTracerStats() override = default;
+
+    void Merge(const G4VAccumulable& other) override;
+    void Reset() override;
+
+    G4double events = 0.;
+    G4double photons = 0.;
+    G4double seconds = 0.;  // spent in the transport
+    G4double truncated = 0.;  // still alive after the wall limit, dropped
+    // check mode: per-event detected photons, and their squares
+    G4double box = 0.;
+    G4double box2 = 0.;
+    G4double geant4 = 0.;
+    G4double geant42 = 0.;
+};
+
+/// One batch of photons in structure-of-arrays layout. Positions are
+/// relative to the scintillator centre; the per-photon optical constants
+/// are looked up once, when the photon is taken.
+
+struct PhotonBatch
+{
+    std::vector<G4float> x, y, z;
+    std::vector<G4float> dx, dy, dz;
+    std::vector<G4float> time;
+    std::vector<G4float> energy;
+    std::vector<G4float> absorption;  // path left before bulk absorption
+    std::vector<G4float> slowness;    // refractive index / c
+    std::vector<G4float> rindex;
+    std::vector<G4float> reflectivity;  // of the paint
+    std::vector<G4float> pde;
+    std::vector<G4float> weight;
+    std::vector<PhotonOrigin> origin;  // reduced yield, else unused
+    std::vector<G4int> trackID;
+    std::vector<G4int> face;  // axis of the wall it is heading for
+
+    std::size_t Size() const { return x.size(); }
+    void Clear();
+    void Move(std::size_t from, std::size_t to);
+};
+
+/// Thread-local replacement of Geant4 optical transport for the one
+/// geometry it serves: a box scintillator with a painted skin and a box
+/// SiPM against one face, /crd/optical/box/. StackingAction hands it every
+/// optical photon born in the scintillator before it is stacked, and it
+/// moves them in batches: all photons of a batch go to their next wall in
+/// one loop over the arrays, which GCC vectorises at -O3, then each is
+/// resolved at that wall, and the ones still alive go round again.
+///
+/// It follows G4OpBoundaryProcess for the surfaces the geometry uses:
+///
+///   paint    skin surface, dielectric_metal: absorbed with probability
+///            1 - REFLECTIVITY, otherwise reflected as "polished"
+///            (specular) or unified "ground" (SPECULARSPIKE/LOBE and
+///            BACKSCATTER constants, Lambertian for the rest, lobe facets
+///            from sigma alpha)
+///   window   border surface to the SiPM, polished dielectric_dielectric:
+///            Fresnel reflection or refraction with probability
+///            REFLECTIVITY (1 if not given), straight transmission with
+///            TRANSMITTANCE, otherwise absorbed. Without a border surface
+///            it is plain Fresnel. Photons that enter the SiPM are
+///            detected with its PDE and handed to SiPMSD.
+///   bulk     absorption from the scintillator ABSLENGTH, time from its
+///            RINDEX (no dispersion, so the group velocity is c/n)
+///
+/// As for OpticalLUT, the scintillator and the SiPM are unrotated
+/// daughters of a mother placed at the world origin. Fresnel coefficients
+/// are averaged over polarisation, which Geant4 tracks. Photons carry the
+/// OpticalGovernor weight they are born with (reduced yield); its
+/// in-flight rules do not apply here. A photon still alive after 100000
+/// walls (a lossless box) is dropped undetected; the run ends with a
+/// warning if any were.
+///
+///   mode off     Geant4 tracks every photon
+///   mode on      photons in the scintillator are traced here and killed
+///   mode check   Geant4 tracks them as usual, they are traced here as
+///                well, and the run ends with the SiPM counts per event of
+///                both transports side by side
+///
+/// The light-collection map calibration sees only photons Geant4 tracks:
+/// calibrate with the tracer off or in check mode.
+
+class BoxTracer
+{
+  public:
+    enum class Mode { Off, On, Check };
+
+    static BoxTracer* Instance();
+
+    Mode GetMode() const { return fMode; }
+    BoxTracerStats* GetStats() { return &fStats; }
+
+    void BeginOfRun();  // geometry and optical properties
+    void EndOfRun() const;  // master
+
+    // StackingAction: true if the photon was taken and should be killed
+    G4bool Take(const G4Track* track);
+    // Transports the photons taken so far; StackingAction::NewStage
+    void Flush();
+
+    void BeginOfEvent();
+    void EndOfEvent();  // check mode: compares with the SiPM count
+
+  private:
+    BoxTracer();
+
+    void DefineCommands();
+    void SetMode(const G4String& mode);
+    G4bool LocateGeometry();
+
+    void Propagate(std::size_t n);
+    G4bool Interact(std::size_t i);  // false once the photon is gone
+    G4bool OnWindow(std::size_t i) const;
+    // true if the photon enters the SiPM, else the direction is reflected
+    G4bool Fresnel(G4ThreeVector& direction, G4int axis, G4double energy,
+                   G4double rindex) const;
+    void Reflect(G4ThreeVector& direction, const G4ThreeVector& inward, G4double energy) const;
+    G4ThreeVector FacetNormal(const G4ThreeVector& direction, const G4ThreeVector& inward) const;
+    void Detect(std::size_t i);
+
+    Mode fMode = Mode::Off;
+    G4int fBatchSize = 4096;
+    G4bool fReady = false;
+
+    PhotonBatch fBatch;
+    BoxTracerStats fStats;
+    G4double fEventBox = 0.;  // check mode, expected detections
+
+    // geometry, in the scintillator frame
+    G4ThreeVector fCentre;
+    G4double fHalf[3] = {0., 0., 0.};
+    G4int fWindowAxis = 2;
+    G4double fWindowSide = 1.;
+    G4double fWindowCentre[3] = {0., 0., 0.};
+    G4double fWindowHalf[3] = {0., 0., 0.};
+    G4int fChannel = 0;
+    SiPMSD* fSiPMSD = nullptr;
+
+    // optical properties
+    const G4MaterialPropertyVector* fRindex = nullptr;
+    const G4MaterialPropertyVector* fAbsLength = nullptr;
+    const G4MaterialPropertyVector* fSiPMRindex = nullptr;
+    const G4MaterialPropertyVector* fPDE = nullptr;
+    const G4MaterialPropertyVector* fPaintReflectivity = nullptr;
+    const G4MaterialPropertyVector* fSpike = nullptr;
+    const G4MaterialPropertyVector* fLobe = nullptr;
+    const G4MaterialPropertyVector* fBackScatter = nullptr;
+    G4bool fPaintPolished = true;
+    G4double fSigmaAlpha = 0.;
+    G4bool fWindowSurface = false;
+    const G4MaterialPropertyVector* fWindowReflectivity = nullptr;
+    const G4MaterialPropertyVector* fWindowTransmittance = nullptr;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
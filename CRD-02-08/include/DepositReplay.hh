@@ -0,0 +1,104 @@
+// Two-pass simulation: record scintillator deposits, replay selected events
+// Yale Cubesat
+
+#ifndef B1DepositReplay_h
+#define B1DepositReplay_h 1
+
+#include "G4VUserEventInformation.hh"
+#include "globals.hh"
+
+#include <memory>
+#include <vector>
+
+class G4Event;
+class G4GenericMessenger;
+
+namespace B1
+{
+
+struct ReplaySelection;
+
+/// Attached to every replayed event: which record-pass event it came from,
+/// and that event's weight, deposited energy and primary energy, which the
+/// event summary reports instead of the optical primaries'.
+
+class ReplayEventInfo : public G4VUserEventInformation
+{
+  public:
+    ReplayEventInfo(G4int sourceEvent, G4double weight, G4double edep, G4double primaryEnergy)
+      : fSourceEvent(sourceEvent), fWeight(weight), fEdep(edep), fPrimaryEnergy(primaryEnergy)
+    {}
+    ~ReplayEventInfo() override = default;
+
+    void Print() const override;
+
+    G4int GetSourceEvent() const { return fSourceEvent; }
+    G4double GetWeight() const { return fWeight; }
+    G4double GetEdep() const { return fEdep; }
+    G4double GetPrimaryEnergy() const { return fPrimaryEnergy; }
+
+  private:
+    G4int fSourceEvent;
+    G4double fWeight;
+    G4double fEdep;
+    G4double fPrimaryEnergy;
+};
+
+/// Thread-local switch for the two-pass workflow, /crd/twopass/.
+///
+/// record: scintillation and Cherenkov light are switched off, and the
+/// energy-deposit steps in the scintillator of every event are written to
+/// deposits.crdh (see DepositWriter).
+///
+/// replay: the master reads the deposit file at the start of the run and
+/// keeps the events above minEdep, or those listed in an event file. Every
+/// replayed event is one selected source event, whose primaries are the
+/// scintillation photons of its deposits: Poisson(yield x edep) per step,
+/// emitted isotropically at the step midpoint after an exponential decay
+/// time, with energies from the scintillator's emission spectrum. Cherenkov
+/// light is not replayed. Threads take the selected events in turn and the
+/// run stops once they are used up, so /run/beamOn with at least the number
+/// printed at the start of the run replays them all.
+
+class DepositReplay
+{
+  public:
+    enum class Mode { Off, Record, Replay };
+
+    static DepositReplay* Instance();
+
+    Mode GetMode() const { return fMode; }
+
+    void BeginOfRun(G4bool isMaster);
+    void GeneratePrimaries(G4Event* event);
+
+  private:
+    DepositReplay();
+
+    void DefineCommands();
+    void SetMode(const G4String& mode);
+    std::shared_ptr<const ReplaySelection> Select() const;
+    G4bool LocateScintillator();
+    G4double SampleEnergy() const;
+
+    Mode fMode = Mode::Off;
+    G4String fFileName = "deposits.crdh";
+    G4String fEventFile;
+    G4double fMinEdep = 0.;
+
+    std::shared_ptr<const ReplaySelection> fSelection;
+
+    // scintillator light: yield per energy, decay time and the emission
+    // spectrum, with its cumulative integral, at the points fEnergy
+    G4double fYield = 0.;
+    G4double fDecayTime = 0.;
+    std::vector<G4double> fEnergy;
+    std::vector<G4double> fDensity;
+    std::vector<G4double> fCdf;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
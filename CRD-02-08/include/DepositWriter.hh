@@ -0,0 +1,107 @@
+// Scintillator energy deposits of the record pass
+// Yale Cubesat
+
+#ifndef B1DepositWriter_h
+#define B1DepositWriter_h 1
+
+#include "G4SystemOfUnits.hh"
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace B1
+{
+
+// Energy-deposit steps of one event, float32 columns in mm, ns and MeV,
+// plus the PDG code of the particle that made the deposit (24 bytes each)
+struct DepositStore
+{
+    std::vector<float> x, y, z, time, edep;
+    std::vector<std::int32_t> pdg;
+
+    void Add(const G4ThreeVector& position, G4double t, G4double e, G4int code)
+    {
+      x.push_back(position.x() / mm);
+      y.push_back(position.y() / mm);
+      z.push_back(position.z() / mm);
+      time.push_back(t / ns);
+      edep.push_back(e / MeV);
+      pdg.push_back(code);
+    }
+
+    std::size_t Size() const { return pdg.size(); }
+    G4bool Empty() const { return pdg.empty(); }
+
+    void Clear()
+    {
+      x.clear();
+      y.clear();
+      z.clear();
+      time.clear();
+      edep.clear();
+      pdg.clear();
+    }
+
+    void Swap(DepositStore& other) noexcept
+    {
+      x.swap(other.x);
+      y.swap(other.y);
+      z.swap(other.z);
+      time.swap(other.time);
+      edep.swap(other.edep);
+      pdg.swap(other.pdg);
+    }
+};
+
+/// Writes deposits.crdh from the output thread with /crd/twopass/mode
+/// record, for every event that deposited energy in the scintillator. Row
+/// groups are cut once chunkSize deposits have been buffered (native byte
+/// order):
+///
+///   header      char[8]  "CRDDEP01"
+///               int32    reserved, 0, 0
+///               int64    total events
+///               int64    row groups
+///   row group   int32    events n
+///               int32    deposits m
+///               int32    event ID[n], thread[n], deposits[n]
+///               float32  weight[n]
+///               float32  edep[n], primary energy[n]     MeV
+///               float32  x[m], y[m], z[m]               mm, step midpoint
+///               float32  time[m]                        ns
+///               float32  edep[m]                        MeV
+///               int32    pdg[m]
+///
+/// DepositReplay reads it back for the replay pass, analysis/crd_hits.py
+/// with read_deposits().
+
+class DepositWriter
+{
+  public:
+    void Open(G4int chunkSize);
+    void Add(const DepositStore& deposits, G4int eventID, G4int thread, G4double weight,
+             G4double edep, G4double primaryEnergy);
+    void Close();
+
+    G4long GetCount() const { return fCount; }
+
+  private:
+    void WriteGroup();
+    void WriteHeader();
+
+    std::ofstream fFile;
+    G4long fCount = 0;
+    G4long fGroups = 0;
+    G4int fChunkSize = 65536;
+
+    std::vector<std::int32_t> fEvent, fThread, fDeposits;
+    std::vector<float> fWeight, fEdep, fEnergy;
+    DepositStore fBuffer;
+};
+
+}  // namespace B1
+
+#endif
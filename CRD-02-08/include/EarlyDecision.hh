@@ -0,0 +1,125 @@
+// Early end of the optical stage once the SiPM decision is known
+// Yale Cubesat
+
+#ifndef B1EarlyDecision_h
+#define B1EarlyDecision_h 1
+
+#include "G4ClassificationOfNewTrack.hh"
+#include "G4VAccumulable.hh"
+#include "globals.hh"
+
+class G4GenericMessenger;
+
+namespace B1
+{
+
+class SiPMSD;
+
+/// Events and photons of a run with early decisions, merged on the master.
+
+class EarlyDecisionStats : public G4VAccumulable
+{
+  public:
+    EarlyDecisionStats() : G4VAccumulable("EarlyDecision") {}
+    ~EarlyDecisionStats() override = default;
+
+    void Merge(const G4VAccumulable& other) override;
+    void Reset() override;
+
+    G4double events = 0.;    // with an optical stage
+    G4double reached = 0.;   // stopped at the decision level
+    G4double hopeless = 0.;  // stopped because it could not be reached
+    G4double photons = 0.;
+    G4double skipped = 0.;
+};
+
+/// Thread-local early decision, /crd/optical/early/. When enabled,
+/// StackingAction defers every optical photon to one of "batches" waiting
+/// stacks, picked at random, so all charged particles are tracked first
+/// and each batch is a random sample of the event's light. Before every
+/// batch the SiPM count so far is compared with the decision level
+/// (stopAt, by default the /crd/trigger/photons requirement):
+///
+///   reached    at least stopAt photons detected already
+///   hopeless   even the projected count of the untracked photons, plus
+///              "confidence" standard deviations, stays below stopAt
+///
+/// Either way the batch that is next is still tracked, as a probe, and
+/// the batches after it are cleared from the stack. The stop depends only
+/// on the batches already tracked and every photon picked its batch at
+/// random, so the probe is a fair sample of what is left: with s batches
+/// tracked at the stop,
+///
+///   estimate = detected before the stop + (batches - s) x probe count
+///
+/// is an unbiased estimate of the full detected count, which a plain
+/// detected / tracked-fraction is not under a data-dependent stop. It
+/// costs one batch per stopped event.
+///
+/// Valid outputs in this mode: the trigger decision (its windows see the
+/// tracked photons only), the event summary's photon estimate and tracked
+/// fraction, edep and everything else that does not need the light. Raw
+/// hits, time histograms, photons and arrival times are those of the
+/// tracked sample. The digitizer, the waveforms and the front-end spectra
+/// need the full light, so the early decision stays off for runs that use
+/// any of them. With no level (stopAt 0 and no /crd/trigger/photons) it
+/// never stops.
+
+class EarlyDecision
+{
+  public:
+    static EarlyDecision* Instance();
+
+    G4bool IsEnabled() const { return fEnabled && !fSuspended; }
+    G4int GetBatches() const { return fBatches; }
+    EarlyDecisionStats* GetStats() { return &fStats; }
+
+    // StackingAction: the waiting stack of a new optical photon
+    G4ClassificationOfNewTrack ClassifyPhoton() const;
+    // StackingAction::NewStage with the tracks left on the stacks, of which
+    // "next" are on the urgent stack: true if the waiting stacks should be
+    // dropped, the urgent one being the probe
+    G4bool NewStage(G4int remaining, G4int next);
+
+    void BeginOfRun();  // off for runs with outputs that need all the light
+    void BeginOfEvent();
+    void EndOfEvent();  // adds the event to the run
+    void EndOfRun() const;  // master
+
+    // Of the optical photons of this event, 1 unless stopped early
+    G4double GetTrackedFraction() const { return fFraction; }
+    // Full detected count from the "detected" photons of the tracked sample
+    G4double EstimateDetected(G4double detected) const
+    {
+      return fOutcome == 0 ? detected : fDetectedAtStop + fScale * (detected - fDetectedAtStop);
+    }
+
+  private:
+    EarlyDecision();
+
+    void DefineCommands();
+    G4int DecisionLevel() const;
+
+    G4bool fEnabled = false;
+    G4bool fSuspended = false;  // this run
+    G4int fBatches = 8;
+    G4int fStopAt = 0;
+    G4double fConfidence = 3.;
+
+    // this event: photons when the optical stage began (-1 before)
+    G4long fTotal = -1;
+    G4double fFraction = 1.;
+    G4int fOutcome = 0;  // 0 full, 1 reached, 2 hopeless
+    G4int fStages = 0;   // batches tracked
+    G4double fDetectedAtStop = 0.;
+    G4double fScale = 1.;  // batches left at the stop, the probe included
+
+    EarlyDecisionStats fStats;
+    SiPMSD* fSiPMSD = nullptr;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
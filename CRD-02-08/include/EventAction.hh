@@ -32,14 +32,19 @@
 
 #include "G4UserEventAction.hh"
 #include "globals.hh"
+#include "DepositWriter.hh"
+#include "EventSummary.hh"
+#include "HitStore.hh"
+#include "SiPMDigitizer.hh"
+#include "Log.hh"
 #include <vector>
-#include <tuple>
 
 class G4Event;
 
 namespace B1
 {
 class RunAction;
+class SiPMSD;
 
 /// Event action class
 class EventAction : public G4UserEventAction
@@ -54,31 +59,61 @@ public:
     // Thread-local energy deposition accumulator
     void AddEdep(G4double edep) { fEdep += edep; }
 
+    // Where the primary first reaches the scintillator, for the event summary
+    void SetPrimaryEntry(const G4ThreeVector& position) {
+        if (fPrimaryEntered) return;
+        fPrimaryEntry = position;
+        fPrimaryEntered = true;
+    }
+
     // Step hits
-    void AddStepHit(const std::tuple<G4double,G4double,G4double,G4double,G4double>& hit) {
-        fStepHits.push_back(hit);
+    void AddStepHit(const G4ThreeVector& position, G4double time, G4double edep,
+                    G4int channel, G4int trackID) {
+        fStepHits.Add(position, time, edep, channel, trackID);
     }
 
-    // Specialized detector hits
-    void AddSiPMHit(const std::tuple<G4double,G4double,G4double,G4double,G4double>& hit) {
-        fSiPMHits.push_back(hit);
-        // Small diagnostic print so you see the per-event insertion
-        G4cout << "[EventAction] AddSiPMHit: event-local sipmHits now=" << fSiPMHits.size()
-            << " (this=" << this << ")" << G4endl;
+    void AddMCHit(const G4ThreeVector& position, G4double time, G4double energy,
+                  G4int channel, G4int trackID) {
+        fMCHits.Add(position, time, energy, channel, trackID);
     }
 
-    void AddMCHit(const std::tuple<G4double,G4double,G4double,G4double,G4double>& hit) {
-        fMCHits.push_back(hit);
+    // Scintillator deposits, /crd/twopass/mode record
+    void AddDeposit(const G4ThreeVector& position, G4double time, G4double edep, G4int pdg) {
+        fDeposits.Add(position, time, edep, pdg);
     }
 
 private:
+    // p.e. per sample over samples of period, from the digitizer's
+    // avalanches, the histogram or the SiPM hits
+    void FillPulseTrain(std::vector<float>& train, G4double period, G4int samples,
+                        G4bool digitized, const SparseTimeHistogram* sparse,
+                        const TimeHistogram* histogram) const;
+
+    // charge p.e. at fractional sample index sample of a pulse train
+    static void AddToTrain(std::vector<float>& train, G4double sample, G4double charge);
+
+    // Arrival times from the histogram when there is one, else from the hits
+    void FillSummary(const G4Event* event, G4bool triggered,
+                     const TimeHistogram* histogram, EventSummary& summary);
+
     RunAction* fRunAction = nullptr;
 
     G4double fEdep = 0.; // Thread-local per event
-
-    std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fStepHits;
-    std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fSiPMHits;
-    std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fMCHits;
+    G4int fSiPMHCID = -1;  // SiPMSD hits collection
+    SiPMSD* fSiPMSD = nullptr;  // its time histogram, in histogram readout
+    G4ThreeVector fPrimaryEntry;
+    G4bool fPrimaryEntered = false;
+    std::vector<float> fTimes;  // scratch for the trigger window and median arrival time
+    SparseTimeHistogram fTriggerBins;  // scratch for the trigger window
+
+    // Capacity is kept from event to event
+    HitStore fStepHits;
+    HitStore fSiPMHits;
+    HitStore fMCHits;
+    DepositStore fDeposits;
+
+    SiPMDigitizer fDigitizer;
+    std::vector<float> fShaperTrain;  // front-end input, reused
 };
 
 }  // namespace B1
@@ -0,0 +1,108 @@
+// Per-event summary rows
+// Yale Cubesat
+
+#ifndef B1EventSummary_h
+#define B1EventSummary_h 1
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace B1
+{
+
+// Digitized SiPM output of one event, from SiPMDigitizer
+struct SiPMSignal
+{
+    G4double charge = 0.;   // p.e., within the gate
+    G4int firedCells = 0;
+    G4double time = 0.;     // when the charge reached the timing threshold
+    G4bool timed = false;
+    G4int darkCounts = 0;   // avalanches added by each effect
+    G4int crosstalk = 0;
+    G4int afterpulses = 0;
+};
+
+// One row per event, filled by EventAction
+struct EventSummary
+{
+    G4double primaryEnergy = 0.;
+    G4ThreeVector primaryDirection;
+    G4ThreeVector entryPoint;  // where the primary first entered the scintillator
+    G4bool entered = false;
+    G4double edep = 0.;    // scintillator
+    G4double weight = 1.;  // source rays the event stands for
+    G4int photons = 0;     // detected at the SiPM
+    G4double tracked = 1.; // fraction of the optical photons tracked, /crd/optical/early/
+    G4double estimate = 0.;  // full detected count, photons unless stopped early
+    G4double yieldFactor = 1.;  // /crd/optical/governor/yieldFactor
+    G4double firstTime = 0.;
+    G4double medianTime = 0.;
+    G4bool triggered = false;
+    G4bool digitized = false;  // /crd/sipm/digi/enable
+    SiPMSignal signal;
+};
+
+/// Writes events.crdh from the output thread, in row groups of chunkSize
+/// events, with the same framing as the hit files (native byte order):
+///
+///   header      char[8]  "CRDEVT05"
+///               int32    reserved, 0, 0
+///               int64    total rows
+///               int64    row groups
+///   row group   int32    rows n
+///               int32    reserved, 0
+///               int32    event ID[n], thread[n]
+///               float32  energy[n]                 MeV
+///               float32  dirX[n], dirY[n], dirZ[n]
+///               float32  entryX[n], entryY[n], entryZ[n]   mm, NaN if
+///                                                  it never got there
+///               float32  edep[n]                   MeV
+///               float32  weight[n]
+///               int32    photons[n]
+///               float32  tracked[n]                fraction of the light
+///                                                  tracked, 1 unless
+///                                                  stopped early
+///               float32  estimate[n]               detected photons of the
+///                                                  whole event, unbiased
+///                                                  when stopped early
+///               float32  yieldFactor[n]            k of a reduced-yield
+///                                                  run, 1 otherwise
+///               float32  firstTime[n], medianTime[n]   ns, NaN if no photon
+///               float32  charge[n]                 p.e., NaN if not digitized
+///               int32    firedCells[n]
+///               float32  signalTime[n]             ns, NaN if below the
+///                                                  timing threshold
+///               uint8    triggered[n]
+///
+/// analysis/crd_hits.py reads it with read_events().
+
+class SummaryWriter
+{
+  public:
+    void Open(G4int chunkSize);
+    void Add(const EventSummary& summary, G4int eventID, G4int thread);
+    void Close();
+
+    G4long GetCount() const { return fCount; }
+
+  private:
+    void WriteGroup();
+
+    std::ofstream fFile;
+    G4long fCount = 0;
+    G4long fGroups = 0;
+    G4int fChunkSize = 65536;
+
+    std::vector<std::int32_t> fEvent, fThread, fPhotons, fFiredCells;
+    std::vector<float> fEnergy, fDirX, fDirY, fDirZ, fEntryX, fEntryY, fEntryZ;
+    std::vector<float> fEdep, fWeight, fTracked, fEstimate, fYieldFactor, fFirstTime, fMedianTime, fCharge, fSignalTime;
+    std::vector<std::uint8_t> fTriggered;
+};
+
+}  // namespace B1
+
+#endif
@@ -0,0 +1,44 @@
+// Radix-2 complex FFT
+// Yale Cubesat
+
+#ifndef B1FFT_h
+#define B1FFT_h 1
+
+#include "globals.hh"
+
+#include <complex>
+#include <vector>
+
+namespace B1
+{
+
+/// In-place iterative FFT of one power-of-two size. The bit-reversal
+/// permutation and twiddle factors are worked out once in the constructor,
+/// so a plan is built per run and then reused for every transform.
+/// Transform() runs over count consecutive arrays of Size() points, which
+/// is how the waveform batches are laid out.
+
+class FFT
+{
+  public:
+    explicit FFT(std::size_t size);
+
+    std::size_t Size() const { return fSize; }
+
+    // Unnormalised: Inverse(Forward(x)) == Size() * x
+    void Forward(std::complex<G4double>* data, std::size_t count = 1) const;
+    void Inverse(std::complex<G4double>* data, std::size_t count = 1) const;
+
+    static std::size_t NextPowerOfTwo(std::size_t n);
+
+  private:
+    void Transform(std::complex<G4double>* data, std::size_t count, G4bool inverse) const;
+
+    std::size_t fSize;
+    std::vector<std::size_t> fSwap;  // (i, j) pairs of the bit-reversal permutation
+    std::vector<std::complex<G4double>> fTwiddle;  // exp(-2 pi i k / size), k < size / 2
+};
+
+}  // namespace B1
+
+#endif
@@ -0,0 +1,97 @@
+// Front-end shaper and threshold discriminators
+// Yale Cubesat
+
+#ifndef B1FrontEnd_h
+#define B1FrontEnd_h 1
+
+#include "G4VAccumulable.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4GenericMessenger;
+
+namespace B1
+{
+
+/// Events over each discriminator threshold, summed over the run. The
+/// integral spectrum counts every threshold an event crosses, like the
+/// flight counters; the differential one only the highest, i.e. events
+/// between that threshold and the next one up. Counts are primary
+/// weights, so the number of events unless the source is biased.
+
+class ThresholdSpectrum : public G4VAccumulable
+{
+  public:
+    ThresholdSpectrum() : G4VAccumulable("ThresholdSpectrum") {}
+    ~ThresholdSpectrum() override = default;
+
+    void Configure(const std::vector<G4double>& thresholds);  // increasing
+
+    void Merge(const G4VAccumulable& other) override;
+    void Reset() override;
+
+    void Fill(G4double amplitude, G4double weight);
+
+    const std::vector<G4double>& GetThresholds() const { return fThresholds; }
+    const std::vector<G4double>& GetIntegral() const { return fIntegral; }
+    const std::vector<G4double>& GetDifferential() const { return fDifferential; }
+
+  private:
+    std::vector<G4double> fThresholds;
+    std::vector<G4double> fIntegral;
+    std::vector<G4double> fDifferential;
+};
+
+/// Thread-local emulation of the flight readout: the SiPM pulse train
+/// goes through a CR-RC shaper, run as two first-order IIR sections (CR
+/// high-pass, then RC low-pass) over the sampled train, and the shaped
+/// peak is compared with a bank of discriminator thresholds.
+///
+/// At the end of the run the master writes the merged spectra in the
+/// form of CR-Binning/data.csv: threshold_counts_<time>.csv with
+/// "voltage,counts" above each threshold, highest first, and
+/// threshold_counts_binned_<time>.csv with the counts between thresholds,
+/// which is what histogram.ipynb used to work out.
+
+class FrontEnd
+{
+  public:
+    static FrontEnd* Instance();
+
+    G4bool IsEnabled() const { return fEnabled; }
+    G4double GetPeriod() const { return fPeriod; }
+    G4int GetSamples() const;
+    ThresholdSpectrum* GetSpectrum() { return &fSpectrum; }
+
+    void BeginOfRun();  // sizes the spectrum and calibrates the gain
+    void EndOfRun();    // master: writes the merged spectra
+
+    // Shaped peak of a train of p.e. per sample, in volts
+    G4double Shape(const std::vector<float>& train) const;
+    void Record(G4double amplitude, G4double weight) { fSpectrum.Fill(amplitude, weight); }
+
+  private:
+    FrontEnd();
+
+    void DefineCommands();
+    void SetThresholds(const G4String& list);
+    G4double Peak(const std::vector<float>& train) const;  // unscaled
+
+    G4bool fEnabled = false;
+    G4double fPeriod;
+    G4double fWindow;
+    G4double fDifferentiation;  // CR time constant
+    G4double fIntegration;      // RC time constant
+    G4double fGain;             // shaped peak of one p.e.
+    G4double fScale = 1.;       // filter output to volts
+    std::vector<G4double> fThresholds;
+
+    ThresholdSpectrum fSpectrum;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
@@ -0,0 +1,63 @@
+// Per-event SiPM arrival-time histograms
+// Yale Cubesat
+
+#ifndef B1HistogramWriter_h
+#define B1HistogramWriter_h 1
+
+#include "SiPMReadout.hh"
+#include "globals.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace B1
+{
+
+/// Writes sipm_histograms.crdh from the output thread with
+/// /crd/sipm/readout histogram, one row per event, in row groups of
+/// chunkSize events (native byte order):
+///
+///   header      char[8]  "CRDTHS01"
+///               float32  bin width          ns
+///               int32    bins in the window
+///               int64    total rows
+///               int64    row groups
+///   row group   int32    rows n
+///               int32    non-empty bins m, summed over the n events
+///               int32    event ID[n], thread[n]
+///               int32    photons[n]          all detected, window or not
+///               int32    overflow[n]         outside the window
+///               int32    entries[n]          non-empty bins of each event
+///               int32    bin[m], count[m]    events one after the other,
+///                                            bins increasing
+///
+/// analysis/crd_hits.py reads it with read_histograms().
+
+class HistogramWriter
+{
+  public:
+    void Open(G4int chunkSize, G4double binWidth, G4int nBins);
+    void Add(const SparseTimeHistogram& histogram, G4int eventID, G4int thread);
+    void Close();
+
+    G4long GetCount() const { return fCount; }
+
+  private:
+    void WriteGroup();
+    void WriteHeader();
+
+    std::ofstream fFile;
+    G4long fCount = 0;
+    G4long fGroups = 0;
+    G4int fChunkSize = 65536;
+    G4double fBinWidth = 0.;
+    G4int fBins = 0;
+
+    std::vector<std::int32_t> fEvent, fThread, fPhotons, fOverflow, fEntries;
+    std::vector<std::int32_t> fBin, fBinCount;
+};
+
+}  // namespace B1
+
+#endif
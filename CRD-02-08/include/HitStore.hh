@@ -0,0 +1,87 @@
+// Structure-of-arrays hit container
+// Yale Cubesat
+
+#ifndef B1HitStore_h
+#define B1HitStore_h 1
+
+#include "G4SystemOfUnits.hh"
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <cstdint>
+#include <vector>
+
+namespace B1
+{
+
+/// One column per field, float32 in mm, ns and eV, plus the channel (copy
+/// number of the volume hit) and the Geant4 track ID: 28 bytes a hit
+/// instead of 40 for five doubles.
+///
+/// Clear() keeps the capacity, and Swap() exchanges whole stores, so an
+/// event action can hand its hits on and get empty but already grown
+/// columns back without touching the allocator.
+
+struct HitStore
+{
+    std::vector<float> x, y, z, time, energy;
+    std::vector<std::int32_t> channel, track;
+
+    void Add(const G4ThreeVector& position, G4double t, G4double e, G4int ch, G4int trackID)
+    {
+      x.push_back(position.x() / mm);
+      y.push_back(position.y() / mm);
+      z.push_back(position.z() / mm);
+      time.push_back(t / ns);
+      energy.push_back(e / eV);
+      channel.push_back(ch);
+      track.push_back(trackID);
+    }
+
+    void Append(const HitStore& other)
+    {
+      Extend(x, other.x);
+      Extend(y, other.y);
+      Extend(z, other.z);
+      Extend(time, other.time);
+      Extend(energy, other.energy);
+      Extend(channel, other.channel);
+      Extend(track, other.track);
+    }
+
+    std::size_t Size() const { return track.size(); }
+    G4bool Empty() const { return track.empty(); }
+
+    void Clear()
+    {
+      x.clear();
+      y.clear();
+      z.clear();
+      time.clear();
+      energy.clear();
+      channel.clear();
+      track.clear();
+    }
+
+    void Swap(HitStore& other) noexcept
+    {
+      x.swap(other.x);
+      y.swap(other.y);
+      z.swap(other.z);
+      time.swap(other.time);
+      energy.swap(other.energy);
+      channel.swap(other.channel);
+      track.swap(other.track);
+    }
+
+  private:
+    template <typename T>
+    static void Extend(std::vector<T>& to, const std::vector<T>& from)
+    {
+      to.insert(to.end(), from.begin(), from.end());
+    }
+};
+
+}  // namespace B1
+
+#endif
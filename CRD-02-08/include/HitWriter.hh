@@ -0,0 +1,73 @@
+// Binary columnar hit files
+// Yale Cubesat
+
+#ifndef B1HitWriter_h
+#define B1HitWriter_h 1
+
+#include "HitStore.hh"
+#include "globals.hh"
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <vector>
+
+namespace B1
+{
+
+enum class HitType : G4int { SiPM = 0, MC, Step, Count };
+constexpr G4int kHitTypes = static_cast<G4int>(HitType::Count);
+
+/// Owned by the output thread, so it is only ever used from one thread.
+/// Hits are buffered per type and per source thread, and every chunkSize
+/// hits the buffer is appended to the file as one row group, so memory
+/// stays flat however long the run.
+///
+/// One file per hit type, hits_sipm.crdh, hits_mc.crdh and hits_step.crdh,
+/// native byte order (little-endian on every machine we run on):
+///
+///   header      char[8]  "CRDHITS2"
+///               int32    hit type (0 SiPM, 1 MC, 2 Step)
+///               int32    reserved, 0
+///               int64    total rows
+///               int64    row groups
+///   row group   int32    rows n
+///               int32    Geant4 thread ID (-1 in sequential mode)
+///               float32  x[n], y[n], z[n]   mm
+///               float32  time[n]            ns
+///               float32  energy[n]          eV
+///               int32    channel[n]         copy number of the volume hit
+///               int32    track ID[n]
+///               int32    event ID[n]
+///
+/// analysis/crd_hits.py reads it into numpy arrays.
+
+class HitWriter
+{
+  public:
+    void Open(G4int chunkSize);
+    void Add(HitType type, const HitStore& hits, G4int eventID, G4int thread);
+    void Close();  // writes the partial row groups and fills in the headers
+
+    G4long GetCount(HitType type) const { return fCount[static_cast<G4int>(type)]; }
+
+  private:
+    // One row group being filled
+    struct Buffer
+    {
+        HitStore hits;
+        std::vector<std::int32_t> event;
+    };
+
+    void WriteGroup(G4int type, G4int thread, Buffer& buffer);
+
+    std::map<G4int, Buffer> fBuffer[kHitTypes];  // keyed by source thread
+    std::ofstream fFile[kHitTypes];
+    G4long fCount[kHitTypes] = {0, 0, 0};
+    G4long fGroups[kHitTypes] = {0, 0, 0};
+    G4int fChunkSize = 65536;
+};
+
+}  // namespace B1
+
+#endif
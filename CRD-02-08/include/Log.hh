@@ -0,0 +1,79 @@
+// Levelled, per-component logging for the hot paths
+// Yale Cubesat
+
+#ifndef B1Log_h
+#define B1Log_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <sstream>
+
+namespace B1
+{
+
+enum class LogLevel : G4int { Error = 0, Warning, Info, Debug, Trace };
+enum class LogCategory : G4int { SD = 0, Event, Run, Generator, Optical, Detector, Count };
+
+/// Messages go to a per-thread buffer that is handed to G4cout in large
+/// chunks (when it fills up, and at the end of every event and run), so
+/// workers do not contend on the locked MT output stream line by line.
+///
+/// Each category has a runtime level, set with /crd/log/<category>. A
+/// disabled call costs one relaxed atomic load; calls above
+/// CRD_LOG_COMPILED_LEVEL (Debug in NDEBUG builds, Trace otherwise) are
+/// removed by the compiler, arguments included.
+
+class Log
+{
+  public:
+    static G4bool IsEnabled(LogCategory category, LogLevel level)
+    {
+      return static_cast<G4int>(level)
+             <= fLevels[static_cast<G4int>(category)].load(std::memory_order_relaxed);
+    }
+
+    static void SetLevel(LogCategory category, LogLevel level);
+    static void SetAllLevels(LogLevel level);
+
+    // Line being built for the calling thread; Commit() moves it to the buffer
+    static std::ostringstream& Line();
+    static void Commit();
+
+    // Hands this thread's buffer to G4cout
+    static void Flush();
+
+    // Master-side /crd/log/ commands; call once from main()
+    static void DefineCommands();
+
+  private:
+    static std::atomic<G4int> fLevels[static_cast<G4int>(LogCategory::Count)];
+};
+
+}  // namespace B1
+
+#ifndef CRD_LOG_COMPILED_LEVEL
+#  ifdef NDEBUG
+#    define CRD_LOG_COMPILED_LEVEL 3  // Debug
+#  else
+#    define CRD_LOG_COMPILED_LEVEL 4  // Trace
+#  endif
+#endif
+
+#define CRD_LOG(category, level, message)                                           \
+  do {                                                                             \
+    if constexpr (static_cast<G4int>(B1::LogLevel::level) <= CRD_LOG_COMPILED_LEVEL) { \
+      if (B1::Log::IsEnabled(B1::LogCategory::category, B1::LogLevel::level)) {    \
+        B1::Log::Line() << message;                                                \
+        B1::Log::Commit();                                                         \
+      }                                                                            \
+    }                                                                              \
+  } while (0)
+
+#define CRD_ERROR(category, message) CRD_LOG(category, Error, message)
+#define CRD_WARN(category, message) CRD_LOG(category, Warning, message)
+#define CRD_INFO(category, message) CRD_LOG(category, Info, message)
+#define CRD_DEBUG(category, message) CRD_LOG(category, Debug, message)
+#define CRD_TRACE(category, message) CRD_LOG(category, Trace, message)
+
+#endif
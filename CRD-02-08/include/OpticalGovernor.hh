@@ -0,0 +1,176 @@
+// Optical photon governor: time gate, escape kill and reflection roulette
+// Yale Cubesat
+
+#ifndef B1OpticalGovernor_h
+#define B1OpticalGovernor_h 1
+
+#include "G4VAccumulable.hh"
+#include "globals.hh"
+
+#include <unordered_map>
+#include <vector>
+
+class G4GenericMessenger;
+class G4LogicalVolume;
+class G4OpBoundaryProcess;
+class G4Step;
+class G4Track;
+
+namespace B1
+{
+
+enum class GovernorRule : G4int { Gate = 0, Escape, Roulette, Yield, Count };
+
+/// What the governor did, summed over the events of a run and merged on
+/// the master. Steps saved are an estimate: each photon it killed is
+/// charged the mean number of steps of the photons of its event that
+/// ended by themselves (absorbed, detected or out of the world), less the
+/// steps it had already taken.
+
+class GovernorStats : public G4VAccumulable
+{
+  public:
+    GovernorStats() : G4VAccumulable("OpticalGovernor") {}
+    ~GovernorStats() override = default;
+
+    void Merge(const G4VAccumulable& other) override;
+    void Reset() override;
+
+    G4double events = 0.;
+    G4double photons = 0.;
+    G4double steps = 0.;
+    G4double saved = 0.;
+    G4double killed[static_cast<G4int>(GovernorRule::Count)] = {0., 0., 0., 0.};
+};
+
+/// Where a reduced-yield survivor came from: the scintillating step (a
+/// replayed deposit has no duration) and the photon's own emission time.
+
+struct PhotonOrigin
+{
+    G4double start = 0.;     // global time at the start of the step
+    G4double duration = 0.;
+    G4double emitted = 0.;
+};
+
+/// Thread-local rules that stop optical photons which can no longer
+/// matter, /crd/optical/governor/. All are off by default:
+///
+///   gate      kill photons whose global time is past this, at creation
+///             (StackingAction) or in flight; set it to the SiPM
+///             integration gate, /crd/sipm/digi/gate
+///   escape    kill photons that cross a boundary (OpBoundary refraction
+///             or transmission) into a volume other than the Scintillator
+///             and PhotonDetector, i.e. that left the scintillator through
+///             a non-SiPM face; reflections off the paint stay
+///   roulette  after every N reflections (OpBoundary reflection statuses)
+///             a photon survives with probability "survival"; survivors
+///             count 1/survival times when detected, so SiPM counts stay
+///             unbiased (SiPMSD records whole copies, with the fraction
+///             left over as one more copy at that probability)
+///   yieldFactor k  keep each new scintillation photon (replayed ones
+///             included) with probability 1/k, which is scintillation at
+///             yield/k, and count the survivors k times when detected.
+///             The material's SCINTILLATIONYIELD is left alone, since
+///             OpticalLUT and DepositReplay read it. The copies of a
+///             detected survivor are other photons of the same step: each
+///             gets its own emission time along the step plus the
+///             scintillator decay (SCINTILLATIONTIMECONSTANT1, no rise
+///             time), and the survivor's transit time. Mean counts are
+///             exact; each detection counting k times adds (k - 1) x mean
+///             to the variance, which full_yield_moments() in crd_hits.py
+///             takes off again (analysis/check_yield.py and
+///             yield_check.mac compare with a full-yield run). No effect
+///             in LUT mode.
+///
+/// Photons are tracked one at a time, so the reflection count and the
+/// roulette weight are kept here for the current track rather than in a
+/// per-track information object. The light-collection map calibration
+/// counts photons, not weights: calibrate with the roulette off.
+
+class OpticalGovernor
+{
+  public:
+    static OpticalGovernor* Instance();
+
+    G4bool IsActive() const
+    {
+      return fGate > 0. || fKillEscaped || fRouletteAfter > 0 || fYieldFactor > 1.;
+    }
+    G4double GetYieldFactor() const { return fYieldFactor; }
+    GovernorStats* GetStats() { return &fStats; }
+
+    // StackingAction: false if a new photon is not worth tracking
+    G4bool AcceptNew(const G4Track* track);
+    // SteppingAction, after every optical photon step
+    void Step(const G4Step* step);
+    // SteppingAction, reduced yield: picks the scintillation photons of a
+    // step that survive, before they are stacked
+    void Scintillate(const G4Step* step);
+    // DepositReplay, reduced yield: the deposit time of the next optical
+    // primary, in track ID order
+    void AddReplayed(G4double time);
+    // SiPMSD: how many photons the current optical track stands for
+    G4double GetPhotonWeight(const G4Track* track) const;
+    // SiPMSD, BoxTracer: where a reduced-yield survivor came from, null for
+    // any other photon
+    const PhotonOrigin* GetOrigin(const G4Track* track) const;
+    // Arrival time of another photon of the same origin, for the copies of
+    // one that arrived at "time"
+    G4double CopyTime(const PhotonOrigin& origin, G4double time) const;
+
+    void BeginOfEvent();
+    void EndOfEvent(G4int eventID);  // per-event debug line, adds to the run
+    void EndOfRun() const;           // master: per-event averages
+
+  private:
+    OpticalGovernor();
+
+    void DefineCommands();
+    void LookUp();
+    G4bool IsReflection(const G4Step* step);
+    G4bool IsEscape(const G4Step* step);
+    static G4bool IsScintillation(const G4Track* track);
+
+    G4double fGate = 0.;
+    G4bool fKillEscaped = false;
+    G4int fRouletteAfter = 0;
+    G4double fSurvival = 0.5;
+    G4double fYieldFactor = 1.;
+
+    // current track
+    G4int fTrackID = -1;
+    G4int fReflections = 0;
+    G4double fWeight = 1.;
+
+    // this event
+    struct Counts
+    {
+      G4long photons = 0;
+      G4long steps = 0;
+      G4long killed[static_cast<G4int>(GovernorRule::Count)] = {0, 0, 0, 0};
+      G4long killedSteps = 0;
+      G4long ended = 0;
+      G4long endedSteps = 0;
+    };
+    Counts fEvent;
+    GovernorStats fStats;
+
+    // reduced yield: survivors not yet stacked, then by track ID; the
+    // deposit times of the optical primaries of a replayed event
+    std::unordered_map<const G4Track*, PhotonOrigin> fNewOrigins;
+    std::unordered_map<G4int, PhotonOrigin> fOrigins;
+    std::vector<G4double> fReplayed;
+    G4double fDecayTime = 0.;
+
+    const G4LogicalVolume* fScintillator = nullptr;
+    const G4LogicalVolume* fDetector = nullptr;
+    const G4OpBoundaryProcess* fBoundary = nullptr;
+    G4bool fLookedUp = false;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
@@ -0,0 +1,131 @@
+// Optical light-collection lookup table
+// Yale Cubesat
+
+#ifndef B1OpticalLUT_h
+#define B1OpticalLUT_h 1
+
+#include "G4ThreeVector.hh"
+#include "G4VAccumulable.hh"
+#include "globals.hh"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class G4GenericMessenger;
+class G4Step;
+class G4Track;
+
+namespace B1
+{
+
+class SiPMSD;
+
+/// Voxel map of the scintillator: for photons emitted in each voxel, the
+/// fraction detected by the SiPM (PDE included), their mean energy and a
+/// histogram of the transit time from emission to the SiPM.
+///
+/// Filled by a calibration run with full optical tracking (it is a
+/// G4VAccumulable, so worker maps are merged on the master), saved to disk
+/// and then only read during production runs.
+
+class LightCollectionMap : public G4VAccumulable
+{
+  public:
+    LightCollectionMap() : G4VAccumulable("LightCollectionMap") {}
+    ~LightCollectionMap() override = default;
+
+    void Configure(const G4ThreeVector& halfSize, G4double voxelSize,
+                   G4int nTimeBins, G4double timeWindow, std::uint64_t geometryHash);
+
+    void Merge(const G4VAccumulable& other) override;
+    void Reset() override;
+
+    // calibration
+    void AddEmission(const G4ThreeVector& position);
+    void AddDetection(const G4ThreeVector& emission, G4double transitTime, G4double energy);
+
+    // file layout: "CRDLUT01", hash, nx ny nz nt (int32), half sizes and time
+    // window (double), then emitted, detected, energy sum and nt time bins
+    // per voxel (double)
+    G4bool Save(const G4String& fileName) const;
+    G4bool Load(const G4String& fileName);
+
+    // production: call once after Load, then the accessors below are const
+    void PrepareSampling();
+    G4int VoxelIndex(const G4ThreeVector& position) const;
+    G4double GetCollectionProbability(G4int voxel) const;
+    G4double GetMeanPhotonEnergy(G4int voxel) const;
+    G4double SampleTransitTime(G4int voxel) const;
+
+    std::uint64_t GetGeometryHash() const { return fHash; }
+    G4double GetTotalEmitted() const;
+
+  private:
+    G4ThreeVector fHalfSize;
+    G4int fN[3] = {0, 0, 0};
+    G4int fNTime = 0;
+    G4double fTimeWindow = 0.;
+    std::uint64_t fHash = 0;
+
+    std::vector<G4double> fEmitted;
+    std::vector<G4double> fDetected;
+    std::vector<G4double> fEnergySum;
+    std::vector<G4double> fTimeHist;  // voxel-major, fNTime bins each
+    std::vector<G4float> fTimeCdf;    // normalised per voxel, for sampling
+};
+
+/// Thread-local switch between full optical tracking, calibration of the
+/// light-collection map, and "LUT mode", where scintillation and Cherenkov
+/// photons are not produced and SiPM hits are instead sampled from the map
+/// for every energy-deposit step in the scintillator.
+///
+/// The map file name carries a hash of the scintillator/SiPM geometry and
+/// optical properties, so a stale map is never picked up after a change.
+
+class OpticalLUT
+{
+  public:
+    enum class Mode { Full, Calibrate, Lookup };
+
+    static OpticalLUT* Instance();
+
+    Mode GetMode() const { return fMode; }
+    LightCollectionMap* GetCalibrationMap() { return &fCalibration; }
+
+    void BeginOfRun();
+    void EndOfRun();  // master: writes the merged calibration map
+
+    void RecordEmission(const G4Track* track);
+    void RecordDetection(const G4Track* track);
+    void GenerateHits(const G4Step* step) const;
+
+  private:
+    OpticalLUT();
+
+    void DefineCommands();
+    void SetMode(const G4String& mode);
+    G4bool LocateGeometry();
+    G4String TableFileName() const;
+
+    Mode fMode = Mode::Full;
+    G4double fVoxelSize;
+    G4double fTimeWindow;
+    G4int fTimeBins = 200;
+
+    LightCollectionMap fCalibration;
+    std::shared_ptr<const LightCollectionMap> fTable;
+    SiPMSD* fSiPMSD = nullptr;
+
+    std::uint64_t fGeometryHash = 0;
+    G4ThreeVector fScintHalfSize;
+    G4ThreeVector fSiPMPosition;
+    G4double fYield = 0.;
+    G4double fDecayTime = 0.;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
@@ -0,0 +1,108 @@
+// Dedicated output thread fed by the event actions
+// Yale Cubesat
+
+#ifndef B1OutputThread_h
+#define B1OutputThread_h 1
+
+#include "BoundedQueue.hh"
+#include "DepositWriter.hh"
+#include "EventSummary.hh"
+#include "HistogramWriter.hh"
+#include "HitWriter.hh"
+#include "WaveformWriter.hh"
+#include "globals.hh"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+class G4GenericMessenger;
+
+namespace B1
+{
+
+// Everything one event hands over for output
+struct EventRecord
+{
+    G4int eventID = 0;
+    G4int thread = 0;
+    EventSummary summary;
+    HitStore hits[kHitTypes];  // empty unless raw hits are being recorded
+    G4bool hasTimeHistogram = false;  // /crd/sipm/readout histogram
+    SparseTimeHistogram timeHistogram;
+    std::vector<float> pulseTrain;  // p.e. per waveform sample, /crd/sipm/wave/enable
+    DepositStore deposits;  // scintillator steps, /crd/twopass/mode record
+};
+
+/// Process-wide thread that owns the output files. Workers move their event
+/// records into a bounded lock-free queue at the end of each event and go
+/// straight back to tracking; formatting and file I/O happen here.
+///
+/// Every event the Trigger accepts gives one row of events.crdh. Raw hits are only kept with
+/// /crd/output/hits (SiPM and MC) and /crd/output/stepHits. With
+/// /crd/sipm/readout histogram each event also gives one row of
+/// sipm_histograms.crdh, with /crd/sipm/wave/enable one waveform of
+/// waveforms.crdh, and with /crd/twopass/mode record its energy deposits
+/// go to deposits.crdh.
+///
+/// Written records go back on a second queue with their columns cleared
+/// but not freed; AcquireRecord() reuses them, so after the first events
+/// no hit storage is allocated anywhere in the event loop.
+///
+/// If the queue is full the worker yields until there is room. Those stalls
+/// and the deepest the queue got are reported at the end of the run: stalls
+/// mean the disk cannot keep up, and /crd/output/queueSize only buys slack.
+///
+/// Created on the master from main(), so /crd/output/ lives there; started
+/// and stopped by the master RunAction.
+
+class OutputThread
+{
+  public:
+    static OutputThread* Instance();
+
+    void Start();  // master, BeginOfRunAction
+    std::unique_ptr<EventRecord> AcquireRecord();
+    void Submit(std::unique_ptr<EventRecord> record);
+    void Stop();  // master, EndOfRunAction: drains the queue and closes the files
+
+    G4bool GetRecordHits() const { return fRecordHits; }
+    G4bool GetRecordStepHits() const { return fRecordStepHits; }
+
+  private:
+    OutputThread();
+
+    void DefineCommands();
+    void Loop();
+    void Write(std::unique_ptr<EventRecord>& record);
+
+    std::unique_ptr<BoundedQueue<std::unique_ptr<EventRecord>>> fQueue;
+    std::unique_ptr<BoundedQueue<std::unique_ptr<EventRecord>>> fFreeRecords;
+    std::thread fThread;
+    std::atomic<G4bool> fStopping{false};
+
+    SummaryWriter fSummaries;
+    HitWriter fHits;
+    HistogramWriter fHistograms;
+    G4bool fWriteHistograms = false;  // fixed for the run in Start()
+    WaveformWriter fWaveforms;
+    G4bool fWriteWaveforms = false;
+    DepositWriter fDeposits;
+    G4bool fWriteDeposits = false;
+
+    // Backpressure
+    std::atomic<G4long> fStalls{0};
+    std::atomic<G4long> fStallNanoseconds{0};
+    std::size_t fMaxDepth = 0;  // output thread only
+
+    G4int fQueueSize = 1024;
+    G4int fChunkSize = 65536;
+    G4bool fRecordHits = false;
+    G4bool fRecordStepHits = false;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
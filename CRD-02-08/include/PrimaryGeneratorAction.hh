@@ -30,8 +30,13 @@
 #ifndef B1PrimaryGeneratorAction_h
 #define B1PrimaryGeneratorAction_h 1
 
+#include "G4ThreeVector.hh"
 #include "G4VUserPrimaryGeneratorAction.hh"
+#include "SpectrumSampler.hh"
 
+#include <memory>
+
+class G4GenericMessenger;
 class G4ParticleGun;
 class G4Event;
 class G4Box;
@@ -41,8 +46,9 @@ namespace B1
 
 /// The primary generator action class with particle gun.
 ///
-/// The default kinematic is a 6 MeV gamma, randomly distribued
-/// in front of the phantom across 80% of the (X,Y) phantom size.
+/// Protons are drawn from the spectrum table and either aimed roughly at
+/// the origin from a sphere ("legacy" mode) or generated as an isotropic
+/// flux restricted to rays that cross the target box ("isotropic" mode).
 
 class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 {
@@ -56,9 +62,38 @@ class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
     // method to access particle gun
     const G4ParticleGun* GetParticleGun() const { return fParticleGun; }
 
+    // times the proton energy sampler against the old rejection loop
+    void BenchmarkEnergySampler(G4int nDraws);
+
+    // replaces the proton spectrum with a tabulated (energy, flux) csv
+    void SetSpectrumFile(const G4String& fileName);
+
+    // "legacy" (aimed at the origin from a sphere) or "isotropic"
+    void SetSourceMode(const G4String& mode);
+    // box the isotropic rays must cross: "scintillator" or "shell"
+    void SetSourceTarget(const G4String& target);
+
   private:
+    void DefineCommands();
+    G4bool LocateIsotropicTarget();
+    void GenerateIsotropicRay(G4ThreeVector& position, G4ThreeVector& direction);
+
     G4ParticleGun* fParticleGun = nullptr;  // pointer a to G4 gun class
     G4Box* fEnvelopeBox = nullptr;
+    G4GenericMessenger* fMessenger = nullptr;
+
+    // Isotropic source: rays uniform over a disk of radius fSourceRadius
+    // (the target's circumscribed sphere) for a uniformly random direction,
+    // kept only if they cross the target box. Each fired event then stands
+    // for fIsotropicWeight rays of the unbiased source.
+    G4bool fIsotropic = false;
+    G4String fTargetName = "Scintillator";
+    G4Box* fTargetBox = nullptr;
+    G4double fSourceRadius = 0.;
+    G4double fIsotropicWeight = 1.;
+
+    // proton spectrum table, shared between threads when loaded from file
+    std::shared_ptr<const SpectrumSampler> fEnergySampler;
 };
 
 }  // namespace B1
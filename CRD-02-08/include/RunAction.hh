@@ -29,9 +29,6 @@
 
 #include "G4UserRunAction.hh"
 #include "G4Accumulable.hh"
-#include "G4Threading.hh"
-#include <vector>
-#include <tuple>
 
 namespace B1
 {
@@ -47,27 +44,23 @@ public:
     // Thread-safe energy deposition
     void AddEdep(G4double edep);  // do NOT make this const
 
-    // Hit merging
-    void MergeSiPMHits(const std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>>& hits);
-    void MergeMCHits(const std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>>& hits);
-    void MergeStepHits(const std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>>& hits);
+    // Source rays each event stands for (1 unless the source is biased)
+    void AddPrimaryWeight(G4double weight) { fPrimaryWeight += weight; }
 
-private:
-    static G4Mutex fAllHitsMutex;
-
-    
-
-    //std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fAllSiPMHits;
-    //std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fAllMCHits;
-    //std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fAllStepHits;
+    // Trigger efficiency: accepted events only; a rejected one adds just its
+    // edep and weight to the run
+    void CountTrigger(G4bool accepted, G4double weight) {
+        if (!accepted) return;
+        fAccepted += 1.;
+        fAcceptedWeight += weight;
+    }
 
-    // Global merged hits
-    static std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fGlobalSiPMHits;
-    static std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fGlobalMCHits;
-    static std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> fGlobalStepHits;
-
-    // Thread-local accumulators (not strictly needed anymore if you always merge immediately)
+private:
+    // Thread-local accumulators, merged on the master at the end of the run
     G4Accumulable<G4double> fEdep;
+    G4Accumulable<G4double> fPrimaryWeight;
+    G4Accumulable<G4double> fAccepted;
+    G4Accumulable<G4double> fAcceptedWeight;
 
 };
 
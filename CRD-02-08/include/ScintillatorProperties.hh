@@ -0,0 +1,40 @@
+// Scintillation constants read from the scintillator material
+// Yale Cubesat
+
+#ifndef B1ScintillatorProperties_h
+#define B1ScintillatorProperties_h 1
+
+#include "G4MaterialPropertyVector.hh"
+#include "G4SystemOfUnits.hh"
+#include "globals.hh"
+
+class G4Material;
+
+namespace B1
+{
+
+/// Constants of a single-component scintillator, under the Geant4 11
+/// property names or the old ones, for the stages that make scintillation
+/// light or photoelectrons without G4Scintillation: the light-collection
+/// map, the two-pass replay and the parameterised response.
+
+struct ScintillatorProperties
+{
+    // Emission peak, where properties are probed and the photon energy
+    // when the material has no spectrum
+    static constexpr G4double kPeakEnergy = 2.818 * CLHEP::eV;
+
+    G4double yield = 0.;      // SCINTILLATIONYIELD
+    G4double decayTime = 0.;  // SCINTILLATIONTIMECONSTANT1 or FASTTIMECONSTANT
+    // SCINTILLATIONCOMPONENT1 or FASTCOMPONENT, null without one
+    const G4MaterialPropertyVector* spectrum = nullptr;
+
+    // False if the material has no properties table; missing ones stay 0
+    G4bool Read(const G4Material* material);
+    // Of the spectrum, linear between its points; kPeakEnergy without one
+    G4double MeanEnergy() const;
+};
+
+}  // namespace B1
+
+#endif
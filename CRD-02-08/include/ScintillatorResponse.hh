@@ -0,0 +1,111 @@
+// Parameterised scintillator response: deposits straight to SiPM photoelectrons
+// Yale Cubesat
+
+#ifndef B1ScintillatorResponse_h
+#define B1ScintillatorResponse_h 1
+
+#include "G4ThreeVector.hh"
+#include "G4VFastSimulationModel.hh"
+#include "globals.hh"
+
+class G4EmCalculator;
+class G4GenericMessenger;
+class G4Material;
+class G4Step;
+class G4Track;
+
+namespace B1
+{
+
+class SiPMSD;
+
+/// Thread-local parameterisation of the light the SiPM sees, /crd/param/.
+/// Each energy deposit in the scintillator gives
+///
+///   photoelectrons  Poisson(yield x Birks-quenched energy x efficiency),
+///                   yield the material's SCINTILLATIONYIELD and
+///                   efficiency the light collection times the PDE
+///   times           deposit time + scintillation decay + Gaussian transit
+///                   time ("transit" mean, "transitSpread" sigma)
+///
+/// Steps are quenched with dE/dx = edep / step length. Particles stopped by
+/// the ScintillatorResponseModel below "threshold" are quenched over their
+/// whole remaining range from the dE/dx tables. Full optical tracking has
+/// no Birks saturation: set birks 0 to compare a calibration run with it.
+///
+/// It is live for a run when the model is active at its start, i.e. after
+///   /param/activateModel ScintillatorResponse
+/// (/param/inActivateModel switches back to optical photons, the default).
+/// While live, Scintillation and Cerenkov are inactivated for the run, any
+/// other optical photon made by a charged particle is killed at stacking,
+/// and the light-collection map lookup is not used.
+
+class ScintillatorResponse
+{
+  public:
+    static ScintillatorResponse* Instance();
+
+    void BeginOfRun();  // material constants, the SiPM and the model state
+
+    G4bool IsLive() const { return fLive; }
+    G4double GetThreshold() const { return fThreshold; }
+
+    // Model: the track is stopped here; its kinetic energy is deposited by
+    // the step that follows, with this visible energy
+    void Stop(const G4Track* track);
+    // SteppingAction: photoelectrons of a scintillator step with a deposit
+    void Convert(const G4Step* step);
+
+  private:
+    ScintillatorResponse();
+
+    void DefineCommands();
+    G4bool Setup();  // true if live for this run
+    G4double Quench(const G4Track* track) const;
+
+    G4double fThreshold;
+    G4double fEfficiency = 0.05;
+    G4double fBirks;
+    G4double fTransit;
+    G4double fTransitSpread;
+
+    G4bool fLive = false;  // model active, and this thread has the SiPM
+    G4double fYield = 0.;
+    G4double fDecayTime = 0.;
+    G4double fPhotonEnergy = 0.;  // mean of the emission spectrum
+    G4ThreeVector fSiPMPosition;
+    G4int fChannel = 0;
+    SiPMSD* fSiPMSD = nullptr;
+    const G4Material* fMaterial = nullptr;
+    G4EmCalculator* fCalculator = nullptr;
+
+    // visible energy of the track the model just stopped
+    G4int fPendingTrack = -1;
+    G4double fPendingVisible = 0.;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+/// Fast-simulation model of the "ScintillatorRegion" envelope, inactive
+/// until /param/activateModel ScintillatorResponse. It takes electrons,
+/// protons, deuterons and alphas, which have no at-rest processes; positrons
+/// (annihilation), muons and pions (decay, capture) and ions are always
+/// transported to the end. Above the ScintillatorResponse threshold they
+/// are transported normally; below it they are stopped on the spot with
+/// their kinetic energy deposited, and ScintillatorResponse turns every
+/// deposit into SiPM photoelectrons.
+
+class ScintillatorResponseModel : public G4VFastSimulationModel
+{
+  public:
+    explicit ScintillatorResponseModel(G4Region* envelope);
+    ~ScintillatorResponseModel() override = default;
+
+    G4bool IsApplicable(const G4ParticleDefinition& particle) override;
+    G4bool ModelTrigger(const G4FastTrack& fastTrack) override;
+    void DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep) override;
+};
+
+}  // namespace B1
+
+#endif
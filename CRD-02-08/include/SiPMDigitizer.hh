@@ -0,0 +1,72 @@
+// SiPM microcell digitizer
+// Yale Cubesat
+
+#ifndef B1SiPMDigitizer_h
+#define B1SiPMDigitizer_h 1
+
+#include "EventSummary.hh"
+#include "SiPMReadout.hh"
+#include "globals.hh"
+
+#include <unordered_map>
+#include <vector>
+
+namespace B1
+{
+
+/// Turns the photons detected in one event into the SiPM signal, cell by
+/// cell: a photon fires a random microcell, and every avalanche can set
+/// off a crosstalk avalanche in one of its four neighbours and an
+/// afterpulse in its own cell later on. Dark counts are added over the
+/// gate. A cell fired again before it has recharged only gives
+/// 1 - exp(-dt / recoveryTime) p.e., which is what saturates the signal
+/// of a large pulse; crosstalk and afterpulse probabilities scale with
+/// that charge too.
+///
+/// Avalanches are handled in time order from a heap, and only the cells
+/// that fired are stored (cell -> last avalanche time), so the cost
+/// follows the number of avalanches, not the 22k cells of the device.
+///
+/// Photon positions are not used: the light reaching the SiPM through the
+/// scintillator face is taken to be uniform over its cells.
+///
+/// One per worker, owned by EventAction.
+
+class SiPMDigitizer
+{
+  public:
+    void Clear();
+    void AddPhoton(G4double time);
+    void AddPhotons(G4double binStart, G4double binWidth, G4int count);  // histogram readout
+
+    // Clears the photons it was given
+    void Digitize(const SiPMResponse& response, SiPMSignal& signal);
+
+    // Avalanches of the last Digitize() inside the gate, in time order
+    struct Pulse
+    {
+        G4double time;
+        G4double charge;  // p.e.
+    };
+    const std::vector<Pulse>& GetPulses() const { return fPulses; }
+
+  private:
+    struct Avalanche
+    {
+        G4double time;
+        G4int cell;
+        G4bool operator>(const Avalanche& other) const { return time > other.time; }
+    };
+
+    G4int RandomCell(G4int cells) const;
+    G4int Neighbour(G4int cell, G4int cells) const;
+
+    std::vector<G4double> fPhotons;
+    std::vector<Avalanche> fHeap;  // min-heap on time
+    std::unordered_map<G4int, G4double> fFired;
+    std::vector<Pulse> fPulses;
+};
+
+}  // namespace B1
+
+#endif
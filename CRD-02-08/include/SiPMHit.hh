@@ -0,0 +1,67 @@
+// SiPM photon hit
+// Yale Cubesat
+
+#ifndef B1SiPMHit_h
+#define B1SiPMHit_h 1
+
+#include "G4Allocator.hh"
+#include "G4THitsCollection.hh"
+#include "G4ThreeVector.hh"
+#include "G4VHit.hh"
+#include "globals.hh"
+
+namespace B1
+{
+
+/// One detected photon: where and when it entered the SiPM, its energy,
+/// the SiPM copy number and the photon's track ID. Allocated from a
+/// per-thread G4Allocator pool, so hits cost no heap allocation once the
+/// pool has grown.
+
+class SiPMHit : public G4VHit
+{
+  public:
+    SiPMHit() = default;
+    SiPMHit(const G4ThreeVector& position, G4double time, G4double energy, G4int channel,
+            G4int trackID)
+      : fPosition(position), fTime(time), fEnergy(energy), fChannel(channel), fTrackID(trackID)
+    {}
+    ~SiPMHit() override = default;
+
+    inline void* operator new(size_t);
+    inline void operator delete(void*);
+
+    void Print() override;
+
+    const G4ThreeVector& GetPosition() const { return fPosition; }
+    G4double GetTime() const { return fTime; }
+    G4double GetEnergy() const { return fEnergy; }
+    G4int GetChannel() const { return fChannel; }
+    G4int GetTrackID() const { return fTrackID; }
+
+  private:
+    G4ThreeVector fPosition;
+    G4double fTime = 0.;
+    G4double fEnergy = 0.;
+    G4int fChannel = 0;
+    G4int fTrackID = 0;
+};
+
+using SiPMHitsCollection = G4THitsCollection<SiPMHit>;
+
+extern G4ThreadLocal G4Allocator<SiPMHit>* SiPMHitAllocator;
+
+inline void* SiPMHit::operator new(size_t)
+{
+  if (!SiPMHitAllocator) SiPMHitAllocator = new G4Allocator<SiPMHit>;
+  return (void*)SiPMHitAllocator->MallocSingle();
+}
+
+inline void SiPMHit::operator delete(void* hit)
+{
+  SiPMHitAllocator->FreeSingle((SiPMHit*)hit);
+}
+
+}  // namespace B1
+
+#endif
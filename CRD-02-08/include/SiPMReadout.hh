@@ -0,0 +1,134 @@
+// SiPM readout settings and the compressed arrival-time histogram
+// Yale Cubesat
+
+#ifndef B1SiPMReadout_h
+#define B1SiPMReadout_h 1
+
+#include "globals.hh"
+
+#include <cstdint>
+#include <vector>
+
+class G4GenericMessenger;
+
+namespace B1
+{
+
+/// Arrival times of one event in fixed bins from t = 0 (the primary
+/// vertex) to the end of the window. Only touched bins are visited when
+/// it is cleared or read out, so the cost follows the number of distinct
+/// bins, and the memory the window length, never the photon count.
+
+class TimeHistogram
+{
+  public:
+    void Configure(G4double binWidth, G4int nBins);
+    void Fill(G4double time);
+    void Clear();
+
+    G4int GetTotal() const { return fTotal; }
+    G4int GetOverflow() const { return fOverflow; }
+    G4double GetFirstTime() const { return fFirstTime; }  // exact
+    G4double GetMedianTime() const;  // bin centre
+    G4double GetBinWidth() const { return fBinWidth; }
+    G4int GetNumberOfBins() const { return fCounts.size(); }
+
+    // (bin, count) pairs in increasing bin order
+    void GetNonZero(std::vector<std::int32_t>& bins, std::vector<std::int32_t>& counts) const;
+
+  private:
+    G4double fBinWidth = 1.;
+    std::vector<std::int32_t> fCounts;
+    mutable std::vector<std::int32_t> fTouched;  // sorted on read-out
+    G4int fTotal = 0;
+    G4int fOverflow = 0;  // t < 0 or past the window
+    G4double fFirstTime = 0.;
+};
+
+// What an event hands to the output thread in histogram mode
+struct SparseTimeHistogram
+{
+    G4int total = 0;
+    G4int overflow = 0;
+    std::vector<std::int32_t> bin, count;
+
+    void Clear()
+    {
+      total = overflow = 0;
+      bin.clear();
+      count.clear();
+    }
+};
+
+// Microcell response used by SiPMDigitizer; defaults are the onsemi
+// J-60035 datasheet values at 2.5 V overvoltage
+struct SiPMResponse
+{
+    G4bool digitize = false;
+    G4int cells = 22292;
+    G4double recoveryTime;    // microcell recharge time constant
+    G4double crosstalk = 0.08;  // prompt avalanches in a neighbour, per avalanche
+    G4double afterpulse = 0.0075;
+    G4double afterpulseTime;  // mean delay of an afterpulse
+    G4double darkRate;        // whole device
+    G4double gate;            // charge integration window from t = 0
+    G4double timingThreshold = 0.5;  // p.e. of accumulated charge that sets the time
+};
+
+// Sampled SiPM waveforms, synthesised by WaveformWriter
+struct WaveformSettings
+{
+    G4bool enable = false;
+    G4double period;     // sample spacing
+    G4int samples = 512;  // from t = 0
+    G4int batch = 256;   // events convolved together and written as one row group
+    G4double riseTime;   // single-p.e. pulse, unless speFile is set
+    G4double fallTime;
+    G4double speAmplitude = 1.;  // mV, pulse height of 1 p.e.
+    G4String speFile;    // "time [ns], amplitude" rows, scaled to speAmplitude
+};
+
+/// Process-wide SiPM readout settings under /crd/sipm/, created on the
+/// master from main() and only read by the workers.
+///
+/// readout hits: one SiPMHit per detected photon (default).
+/// readout histogram: SiPMSD only fills a TimeHistogram per event, and that
+/// is what gets written instead of the photon hits.
+///
+/// /crd/sipm/digi/ sets the SiPMResponse the detected photons are digitized
+/// with at the end of each event, and /crd/sipm/wave/ the waveforms built
+/// from them.
+
+class SiPMReadout
+{
+  public:
+    enum class Mode { Hits, Histogram };
+
+    static SiPMReadout* Instance();
+
+    Mode GetMode() const { return fMode; }
+    G4double GetBinWidth() const { return fBinWidth; }
+    G4int GetNumberOfBins() const;
+    const SiPMResponse& GetResponse() const { return fResponse; }
+    const WaveformSettings& GetWaveform() const { return fWaveform; }
+
+  private:
+    SiPMReadout();
+
+    void DefineCommands();
+    void SetMode(const G4String& mode);
+
+    Mode fMode = Mode::Hits;
+    G4double fBinWidth;
+    G4double fWindow;
+    SiPMResponse fResponse;
+    WaveformSettings fWaveform;
+
+    G4GenericMessenger* fMessenger = nullptr;
+    G4GenericMessenger* fDigiMessenger = nullptr;
+    G4GenericMessenger* fWaveMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
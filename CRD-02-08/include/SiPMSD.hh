@@ -8,34 +8,53 @@
 #include "G4Step.hh"
 #include "G4HCofThisEvent.hh"
 #include "G4OpticalPhoton.hh"
+#include "G4MaterialPropertyVector.hh"
+#include "SiPMHit.hh"
+#include "SiPMReadout.hh"
 #include "globals.hh"
 
-#include <vector>
-#include <string>
-
 namespace B1 {
 
+struct PhotonOrigin;
+
 class SiPMSD : public G4VSensitiveDetector {
 public:
-  struct Hit {
-    G4ThreeVector position;
-    G4double time;
-    G4double energy;
-  };
-
   SiPMSD(const G4String& name);
   virtual ~SiPMSD() = default;
 
-  // Accessor
-  const std::vector<Hit>& GetHits() const { return hits; }
-
-  void Clear() { hits.clear(); }
-
+  // Hits go to "<name>/SiPMHitsCollection" in the event's HCE, or only
+  // to the arrival-time histogram with /crd/sipm/readout histogram
+  virtual void Initialize(G4HCofThisEvent* hce) override;
   virtual G4bool ProcessHits(G4Step* step, G4TouchableHistory* history) override;
   virtual void EndOfEvent(G4HCofThisEvent* hce) override;
 
+  // A detected photon, from ProcessHits or sampled in optical LUT mode
+  void RecordPhoton(const G4ThreeVector& position, G4double time, G4double energy,
+                    G4int channel, G4int trackID);
+  // One that stands for "weight" photons (roulette, reduced yield): whole
+  // copies, plus one more with the probability of the fraction left over.
+  // With an origin (reduced yield) the copies after the first are other
+  // photons of that deposit, each with its own arrival time.
+  void RecordWeighted(const G4ThreeVector& position, G4double time, G4double energy,
+                      G4int channel, G4int trackID, G4double weight,
+                      const PhotonOrigin* origin = nullptr);
+
+  const TimeHistogram& GetTimeHistogram() const { return fTimeHistogram; }
+
+  // Photons recorded so far in this event, hits or histogram
+  G4long GetDetectedCount() const {
+    return fHistogramMode ? fTimeHistogram.GetTotal() : fHitsCollection->entries();
+  }
+
 private:
-  std::vector<Hit> hits;
+  SiPMHitsCollection* fHitsCollection = nullptr;
+  G4int fHCID = -1;
+
+  G4bool fHistogramMode = false;
+  TimeHistogram fTimeHistogram;
+
+  // Detection efficiency vs photon energy, looked up on the first hit
+  const G4MaterialPropertyVector* fPDE = nullptr;
 };
 
 }  // namespace B1
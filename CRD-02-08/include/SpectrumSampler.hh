@@ -0,0 +1,62 @@
+// Tabulated energy spectrum sampler (Walker alias method)
+// Yale Cubesat
+
+#ifndef B1SpectrumSampler_h
+#define B1SpectrumSampler_h 1
+
+#include "globals.hh"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace B1
+{
+
+/// Samples energies from an arbitrary non-negative density on [eMin, eMax].
+///
+/// The density is integrated once into nBins bins and turned into a Walker
+/// alias table, so every draw costs two random numbers and no density
+/// evaluations, independent of the shape of the spectrum. Bins are equal
+/// width in energy, or in log(energy) for spectra spanning several decades;
+/// within a bin the energy (or log-energy) is drawn uniformly.
+///
+/// Sample() only reads the table, so a built sampler can be shared between
+/// worker threads without locking.
+
+class SpectrumSampler
+{
+  public:
+    SpectrumSampler() = default;
+    ~SpectrumSampler() = default;
+
+    /// density is per unit energy in both modes
+    void Build(const std::function<G4double(G4double)>& density,
+               G4double eMin, G4double eMax, G4int nBins, G4bool logBins = false);
+
+    /// Reads "energy [MeV], flux" rows and builds a log-energy table with
+    /// log-log interpolation between points. Tables are cached by file name,
+    /// so all threads loading the same file share one read-only instance.
+    /// Returns nullptr (with a warning) if the file cannot be used.
+    static std::shared_ptr<const SpectrumSampler> LoadCsv(const G4String& fileName,
+                                                          G4int nBins = 4096);
+
+    G4double Sample() const;
+
+    G4bool IsReady() const { return !fProb.empty(); }
+    G4double GetMinEnergy() const { return fEMin; }
+    G4double GetMaxEnergy() const { return fEMax; }
+
+  private:
+    std::vector<G4double> fProb;   // probability of keeping bin i
+    std::vector<G4int> fAlias;     // bin used otherwise
+    G4double fEMin = 0.;
+    G4double fEMax = 0.;
+    G4double fLo = 0.;             // lower edge, in energy or log(energy)
+    G4double fBinWidth = 0.;
+    G4bool fLogBins = false;
+};
+
+}  // namespace B1
+
+#endif
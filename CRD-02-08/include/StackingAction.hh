@@ -0,0 +1,37 @@
+// Stacking action: optical photons that are not worth tracking
+// Yale Cubesat
+
+#ifndef B1StackingAction_h
+#define B1StackingAction_h 1
+
+#include "G4UserStackingAction.hh"
+#include "globals.hh"
+
+namespace B1
+{
+
+/// Hands every new optical photon to the OpticalGovernor, which kills it
+/// before it is stacked if it is born past the time gate. With
+/// /crd/optical/early/enable the survivors wait in random batches behind
+/// the charged particles, and EarlyDecision may clear the stack between
+/// two batches. With /crd/optical/box/mode on, photons born in the
+/// scintillator go to the BoxTracer instead of the stack; the photons it
+/// holds are transported at every new stage, the last one included.
+
+class StackingAction : public G4UserStackingAction
+{
+  public:
+    StackingAction() = default;
+    ~StackingAction() override = default;
+
+    G4ClassificationOfNewTrack ClassifyNewTrack(const G4Track* track) override;
+    void NewStage() override;
+    void PrepareNewEvent() override;
+
+  private:
+    G4int fAdditionalStacks = 0;
+};
+
+}  // namespace B1
+
+#endif
@@ -0,0 +1,66 @@
+// Per-event trigger deciding what gets written
+// Yale Cubesat
+
+#ifndef B1Trigger_h
+#define B1Trigger_h 1
+
+#include "SiPMHit.hh"
+#include "SiPMReadout.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4GenericMessenger;
+
+namespace B1
+{
+
+/// Process-wide trigger under /crd/trigger/, created on the master from
+/// main() and only read by the workers. Two conditions, each off at 0:
+///
+///   photons  at least N detected photons within window ns of each other
+///            (window 0: in the whole event)
+///   edep     scintillator energy deposit of at least edep
+///
+/// combined with logic any (default) or all. With nothing set, the
+/// default, every event is accepted.
+///
+/// EventAction asks first thing at the end of the event. A rejected event
+/// only adds to the trigger counters of RunAction; nothing is merged,
+/// digitized or written for it unless /crd/trigger/persist all.
+
+class Trigger
+{
+  public:
+    static Trigger* Instance();
+
+    // times and bins are scratch space, only filled when a window is set
+    G4bool Accept(G4double edep, const SiPMHitsCollection* hits, std::vector<float>& times) const;
+    G4bool Accept(G4double edep, const TimeHistogram& histogram,
+                  SparseTimeHistogram& bins) const;
+
+    G4bool GetPersistAll() const { return fPersistAll; }
+    G4int GetPhotons() const { return fPhotons; }
+
+  private:
+    Trigger();
+
+    void DefineCommands();
+    void SetLogic(const G4String& logic);
+    void SetPersist(const G4String& persist);
+
+    template <typename PhotonTest>
+    G4bool Decide(G4double edep, PhotonTest photonsPass) const;
+
+    G4int fPhotons = 0;
+    G4double fWindow = 0.;
+    G4double fEdep = 0.;
+    G4bool fRequireAll = false;
+    G4bool fPersistAll = false;
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+
+}  // namespace B1
+
+#endif
@@ -0,0 +1,76 @@
+// Sampled SiPM waveforms
+// Yale Cubesat
+
+#ifndef B1WaveformWriter_h
+#define B1WaveformWriter_h 1
+
+#include "FFT.hh"
+#include "SiPMReadout.hh"
+#include "globals.hh"
+
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace B1
+{
+
+/// Owned by the output thread. Each event arrives as a pulse train, the
+/// p.e. landing in each sample, and leaves as that train convolved with
+/// the single-p.e. pulse. Events are collected into batches of
+/// /crd/sipm/wave/batch and convolved in one go: two trains share each
+/// complex FFT (one as the real, one as the imaginary part, which the
+/// real pulse spectrum keeps apart), all of them are transformed with
+/// one plan, multiplied by the pulse spectrum and transformed back. The
+/// FFT is long enough that the pulse never wraps round into the window.
+///
+/// Writes waveforms.crdh, one batch per row group (native byte order):
+///
+///   header      char[8]  "CRDWAV01"
+///               float32  sample spacing     ns
+///               int32    samples per waveform
+///               int64    total rows
+///               int64    row groups
+///   row group   int32    rows n
+///               int32    reserved, 0
+///               int32    event ID[n], thread[n]
+///               float32  amplitude[n][samples]   mV, one waveform after
+///                                                the other
+///
+/// analysis/crd_hits.py reads it with read_waveforms().
+
+class WaveformWriter
+{
+  public:
+    void Open(const WaveformSettings& settings);
+    void Add(const std::vector<float>& train, G4int eventID, G4int thread);
+    void Close();
+
+    G4long GetCount() const { return fCount; }
+
+  private:
+    void BuildPulse(const WaveformSettings& settings, std::vector<G4double>& pulse) const;
+    G4bool ReadPulse(const G4String& fileName, std::vector<G4double>& pulse) const;
+    void WriteBatch();
+    void WriteHeader();
+
+    std::ofstream fFile;
+    G4long fCount = 0;
+    G4long fGroups = 0;
+    G4double fPeriod = 1.;
+    G4int fSamples = 0;
+    G4int fBatch = 0;
+
+    std::unique_ptr<FFT> fFFT;
+    std::vector<std::complex<G4double>> fPulseSpectrum;  // divided by the FFT size
+    std::vector<std::complex<G4double>> fWork;  // batch / 2 transforms
+
+    std::vector<float> fTrains;  // the batch, samples per event
+    std::vector<std::int32_t> fEvent, fThread;
+};
+
+}  // namespace B1
+
+#endif
@@ -34,6 +34,7 @@
 #include "EventAction.hh"
 #include "PrimaryGeneratorAction.hh"
 #include "RunAction.hh"
+#include "StackingAction.hh"
 #include "SteppingAction.hh"
 
 namespace B1
@@ -66,6 +67,9 @@ void ActionInitialization::Build() const
     // Create SteppingAction and pass pointer to EventAction
     // (SteppingAction can query eventAction for hits if needed)
     SetUserAction(new SteppingAction(eventAction));
+
+    // Optical photons the governor drops before they are stacked
+    SetUserAction(new StackingAction());
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,525 @@
+// Batched optical photon transport in the box scintillator
+// Yale Cubesat
+
+#include "BoxTracer.hh"
+
+#include "Log.hh"
+#include "OpticalGovernor.hh"
+#include "SiPMSD.hh"
+
+#include "G4Box.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalBorderSurface.hh"
+#include "G4LogicalSkinSurface.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4Material.hh"
+#include "G4MaterialPropertiesTable.hh"
+#include "G4OpticalSurface.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SDManager.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Track.hh"
+#include "G4VPhysicalVolume.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace B1
+{
+
+namespace
+{
+// Walls a photon may reach before it is given up on
+constexpr G4int kMaxWalls = 100000;
+
+G4double ValueOr(const G4MaterialPropertyVector* property, G4double energy, G4double fallback)
+{
+  return property ? property->Value(energy) : fallback;
+}
+
+const G4MaterialPropertyVector* Property(const G4MaterialPropertiesTable* mpt, const char* key)
+{
+  return mpt ? mpt->GetProperty(key) : nullptr;
+}
+
+// Every photon to its next wall, or to where it is absorbed on the way.
+// No branches and no library calls, so GCC vectorises the loop at -O3
+// (which CMakeLists.txt gives this file; -fopt-info-vec reports it). The
+// columns never overlap, and without __restrict GCC gives up on run-time
+// alias checks for this many arrays.
+// std::min(a, b) is b < a ? b : a, which keeps a when b is NaN: each
+// candidate distance goes second, so the 0/0 of a photon on a wall it
+// moves along is passed over, as is the infinity of a zero direction
+// component. The face is the first axis with the smallest distance, from
+// the comparison masks.
+void ToNextWall(std::size_t n, G4float hx, G4float hy, G4float hz, G4float* __restrict x,
+                G4float* __restrict y, G4float* __restrict z, const G4float* __restrict dx,
+                const G4float* __restrict dy, const G4float* __restrict dz,
+                G4float* __restrict time, G4float* __restrict absorption,
+                const G4float* __restrict slowness, G4int* __restrict face)
+{
+  constexpr G4float far = std::numeric_limits<G4float>::infinity();
+  for (std::size_t i = 0; i < n; i++) {
+    const G4float tx = (std::copysign(hx, dx[i]) - x[i]) / dx[i];
+    const G4float ty = (std::copysign(hy, dy[i]) - y[i]) / dy[i];
+    const G4float tz = (std::copysign(hz, dz[i]) - z[i]) / dz[i];
+    const G4float wx = std::min(far, tx);
+    const G4int yFirst = ty < wx;
+    const G4float wxy = std::min(wx, ty);
+    const G4int zFirst = tz < wxy;
+    const G4float wall = std::max(std::min(wxy, tz), 0.f);
+    face[i] = yFirst + zFirst * (2 - yFirst);
+    const G4float step = std::min(absorption[i], wall);
+    x[i] += step * dx[i];
+    y[i] += step * dy[i];
+    z[i] += step * dz[i];
+    time[i] += step * slowness[i];
+    absorption[i] -= step;
+  }
+}
+
+template <typename T>
+void MoveElement(std::vector<T>& column, std::size_t from, std::size_t to)
+{
+  column[to] = column[from];
+}
+}  // namespace
+
+void BoxTracerStats::Merge(const G4VAccumulable& other)
+{
+  const auto& rhs = static_cast<const BoxTracerStats&>(other);
+  events += rhs.events;
+  photons += rhs.photons;
+  seconds += rhs.seconds;
+  truncated += rhs.truncated;
+  box += rhs.box;
+  box2 += rhs.box2;
+  geant4 += rhs.geant4;
+  geant42 += rhs.geant42;
+}
+
+void BoxTracerStats::Reset()
+{
+  events = photons = seconds = truncated = box = box2 = geant4 = geant42 = 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhotonBatch::Clear()
+{
+  // clear() keeps the capacity for the next batch
+  for (auto* column : {&x, &y, &z, &dx, &dy, &dz, &time, &energy, &absorption, &slowness,
+                       &rindex, &reflectivity, &pde, &weight})
+    column->clear();
+  origin.clear();
+  trackID.clear();
+  face.clear();
+}
+
+void PhotonBatch::Move(std::size_t from, std::size_t to)
+{
+  for (auto* column : {&x, &y, &z, &dx, &dy, &dz, &time, &energy, &absorption, &slowness,
+                       &rindex, &reflectivity, &pde, &weight})
+    MoveElement(*column, from, to);
+  MoveElement(origin, from, to);
+  MoveElement(trackID, from, to);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+BoxTracer* BoxTracer::Instance()
+{
+  static G4ThreadLocal BoxTracer* instance = nullptr;
+  if (!instance) instance = new BoxTracer();
+  return instance;
+}
+
+BoxTracer::BoxTracer()
+{
+  DefineCommands();
+}
+
+void BoxTracer::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/optical/box/",
+                                      "Batched optical transport in the box scintillator");
+
+  auto& modeCmd = fMessenger->DeclareMethod("mode", &BoxTracer::SetMode,
+                                            "off: Geant4 tracks the light. "
+                                            "on: photons born in the scintillator are traced "
+                                            "in batches instead. "
+                                            "check: both, with the SiPM counts compared at "
+                                            "the end of the run.");
+  modeCmd.SetParameterName("mode", false);
+  modeCmd.SetCandidates("off on check");
+  modeCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& batchCmd = fMessenger->DeclareProperty("batch", fBatchSize,
+                                               "Photons transported together.");
+  batchCmd.SetParameterName("n", false);
+  batchCmd.SetRange("n>=1");
+  batchCmd.SetStates(G4State_PreInit, G4State_Idle);
+}
+
+void BoxTracer::SetMode(const G4String& mode)
+{
+  fMode = Mode::Off;
+  if (mode == "on") fMode = Mode::On;
+  if (mode == "check") fMode = Mode::Check;
+}
+
+G4bool BoxTracer::LocateGeometry()
+{
+  auto* scintLV = G4LogicalVolumeStore::GetInstance()->GetVolume("Scintillator", false);
+  auto* scintPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("Scintillator", false);
+  auto* sipmPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("PhotonDetector", false);
+  auto* scintBox = scintLV ? dynamic_cast<G4Box*>(scintLV->GetSolid()) : nullptr;
+  auto* sipmBox = sipmPV ? dynamic_cast<G4Box*>(sipmPV->GetLogicalVolume()->GetSolid()) : nullptr;
+  if (!scintPV || !scintBox || !sipmBox || scintPV->GetRotation() || sipmPV->GetRotation()) {
+    G4Exception("BoxTracer::LocateGeometry()", "BoxTracer001", JustWarning,
+                "Scintillator or PhotonDetector is not an unrotated box. "
+                "Geant4 tracks the light.");
+    return false;
+  }
+
+  fCentre = scintPV->GetTranslation();
+  fHalf[0] = scintBox->GetXHalfLength();
+  fHalf[1] = scintBox->GetYHalfLength();
+  fHalf[2] = scintBox->GetZHalfLength();
+  const G4double sipmHalf[3] = {sipmBox->GetXHalfLength(), sipmBox->GetYHalfLength(),
+                                sipmBox->GetZHalfLength()};
+
+  // The SiPM sits on the face it touches
+  const G4ThreeVector offset = sipmPV->GetTranslation() - fCentre;
+  fWindowAxis = -1;
+  for (G4int axis = 0; axis < 3; axis++) {
+    fWindowCentre[axis] = offset[axis];
+    fWindowHalf[axis] = sipmHalf[axis];
+    if (std::abs(std::abs(offset[axis]) - fHalf[axis] - sipmHalf[axis]) < 1. * um) {
+      fWindowAxis = axis;
+      fWindowSide = offset[axis] > 0. ? 1. : -1.;
+    }
+  }
+  fChannel = sipmPV->GetCopyNo();
+
+  auto* mpt = scintLV->GetMaterial()->GetMaterialPropertiesTable();
+  auto* sipmMpt = sipmPV->GetLogicalVolume()->GetMaterial()->GetMaterialPropertiesTable();
+  fRindex = Property(mpt, "RINDEX");
+  fAbsLength = Property(mpt, "ABSLENGTH");
+  fSiPMRindex = Property(sipmMpt, "RINDEX");
+  fPDE = Property(sipmMpt, "PDE");
+
+  auto* skin = G4LogicalSkinSurface::GetSurface(scintLV);
+  auto* paint = skin ? dynamic_cast<G4OpticalSurface*>(skin->GetSurfaceProperty()) : nullptr;
+  auto* border = G4LogicalBorderSurface::GetSurface(scintPV, sipmPV);
+  auto* window = border ? dynamic_cast<G4OpticalSurface*>(border->GetSurfaceProperty()) : nullptr;
+
+  G4String problem;
+  if (fWindowAxis < 0)
+    problem = "the SiPM does not touch a scintillator face";
+  else if (!fRindex || !fSiPMRindex)
+    problem = "no RINDEX for the scintillator or the SiPM";
+  else if (!paint || paint->GetType() != dielectric_metal)
+    problem = "the scintillator skin is not a dielectric_metal optical surface";
+  else if (paint->GetFinish() != polished
+           && (paint->GetFinish() != ground || paint->GetModel() != unified))
+    problem = "the scintillator skin is neither polished nor unified ground";
+  else if (border && (!window || window->GetType() != dielectric_dielectric
+                      || window->GetFinish() != polished))
+    problem = "the SiPM window is not a polished dielectric_dielectric surface";
+  if (!problem.empty()) {
+    G4ExceptionDescription msg;
+    msg << "Unsupported geometry: " << problem << ". Geant4 tracks the light.";
+    G4Exception("BoxTracer::LocateGeometry()", "BoxTracer001", JustWarning, msg);
+    return false;
+  }
+
+  auto* paintMpt = paint->GetMaterialPropertiesTable();
+  fPaintReflectivity = Property(paintMpt, "REFLECTIVITY");
+  fSpike = Property(paintMpt, "SPECULARSPIKECONSTANT");
+  fLobe = Property(paintMpt, "SPECULARLOBECONSTANT");
+  fBackScatter = Property(paintMpt, "BACKSCATTERCONSTANT");
+  fPaintPolished = paint->GetFinish() == polished;
+  fSigmaAlpha = paint->GetSigmaAlpha();
+
+  fWindowSurface = window != nullptr;
+  auto* windowMpt = window ? window->GetMaterialPropertiesTable() : nullptr;
+  fWindowReflectivity = Property(windowMpt, "REFLECTIVITY");
+  fWindowTransmittance = Property(windowMpt, "TRANSMITTANCE");
+  return true;
+}
+
+void BoxTracer::BeginOfRun()
+{
+  fReady = false;
+  fBatch.Clear();
+  if (fMode == Mode::Off) return;
+
+  // Hits go to this thread's SiPM detector (none on the master)
+  fSiPMSD = static_cast<SiPMSD*>(
+    G4SDManager::GetSDMpointer()->FindSensitiveDetector("SiPM_SD", false));
+  fReady = LocateGeometry() && fSiPMSD;
+}
+
+void BoxTracer::EndOfRun() const
+{
+  if (fMode == Mode::Off || fStats.photons <= 0.) return;
+
+  CRD_INFO(Optical, "[BoxTracer] " << fStats.photons << " photons traced in "
+         << fStats.seconds << " s, " << 1.e9 * fStats.seconds / fStats.photons
+         << " ns per photon");
+  if (fStats.truncated > 0.) {
+    G4ExceptionDescription msg;
+    msg << fStats.truncated << " of " << fStats.photons << " photons were still alive after "
+        << kMaxWalls << " walls and were dropped undetected.\n"
+        << "Check the paint REFLECTIVITY and the scintillator ABSLENGTH.";
+    G4Exception("BoxTracer::EndOfRun()", "BoxTracer002", JustWarning, msg);
+  }
+  if (fMode != Mode::Check || fStats.events <= 1.) return;
+
+  // Mean SiPM photons per event of either transport, with its standard error
+  const G4double n = fStats.events;
+  const G4double box = fStats.box / n;
+  const G4double geant4 = fStats.geant4 / n;
+  const G4double boxError = std::sqrt(std::max(0., fStats.box2 / n - box * box) / (n - 1.));
+  const G4double geant4Error =
+    std::sqrt(std::max(0., fStats.geant42 / n - geant4 * geant4) / (n - 1.));
+  CRD_INFO(Optical, "[BoxTracer] SiPM photons per event: Geant4 " << geant4 << " +- "
+         << geant4Error << ", box tracer " << box << " +- " << boxError << " (ratio "
+         << (geant4 > 0. ? box / geant4 : 0.) << ")");
+}
+
+G4bool BoxTracer::Take(const G4Track* track)
+{
+  if (!fReady) return false;
+
+  const G4ThreeVector position = track->GetPosition() - fCentre;
+  for (G4int axis = 0; axis < 3; axis++)
+    if (std::abs(position[axis]) >= fHalf[axis]) return false;
+
+  const G4double energy = track->GetKineticEnergy();
+  const G4double rindex = fRindex->Value(energy);
+  const G4ThreeVector direction = track->GetMomentumDirection();
+  G4double absorption = std::numeric_limits<G4float>::max();
+  if (fAbsLength) absorption = -fAbsLength->Value(energy) * std::log(1. - G4UniformRand());
+
+  auto& b = fBatch;
+  b.x.push_back(position.x());
+  b.y.push_back(position.y());
+  b.z.push_back(position.z());
+  b.dx.push_back(direction.x());
+  b.dy.push_back(direction.y());
+  b.dz.push_back(direction.z());
+  b.time.push_back(track->GetGlobalTime());
+  b.energy.push_back(energy);
+  b.absorption.push_back(absorption);
+  b.slowness.push_back(rindex / c_light);
+  b.rindex.push_back(rindex);
+  b.reflectivity.push_back(ValueOr(fPaintReflectivity, energy, 1.));
+  b.pde.push_back(ValueOr(fPDE, energy, 1.));
+  auto* governor = OpticalGovernor::Instance();
+  const auto* origin = governor->GetOrigin(track);
+  b.weight.push_back(governor->GetPhotonWeight(track));
+  b.origin.push_back(origin ? *origin : PhotonOrigin());
+  b.trackID.push_back(track->GetTrackID());
+
+  if (static_cast<G4int>(b.Size()) >= fBatchSize) Flush();
+  return fMode == Mode::On;
+}
+
+void BoxTracer::Flush()
+{
+  const std::size_t total = fBatch.Size();
+  if (total == 0) return;
+  const auto start = std::chrono::steady_clock::now();
+
+  // Every photon to its next wall, then the survivors to the front
+  std::size_t n = total;
+  fBatch.face.resize(n);
+  for (G4int wall = 0; wall < kMaxWalls && n > 0; wall++) {
+    Propagate(n);
+    std::size_t alive = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      if (!Interact(i)) continue;
+      if (alive != i) fBatch.Move(i, alive);
+      alive++;
+    }
+    n = alive;
+  }
+  fBatch.Clear();
+
+  fStats.photons += total;
+  fStats.truncated += n;
+  fStats.seconds += std::chrono::duration<G4double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BoxTracer::Propagate(std::size_t n)
+{
+  auto& b = fBatch;
+  ToNextWall(n, fHalf[0], fHalf[1], fHalf[2], b.x.data(), b.y.data(), b.z.data(), b.dx.data(),
+             b.dy.data(), b.dz.data(), b.time.data(), b.absorption.data(), b.slowness.data(),
+             b.face.data());
+}
+
+G4bool BoxTracer::OnWindow(std::size_t i) const
+{
+  const auto& b = fBatch;
+  const G4double position[3] = {b.x[i], b.y[i], b.z[i]};
+  const G4double direction[3] = {b.dx[i], b.dy[i], b.dz[i]};
+  if (b.face[i] != fWindowAxis || direction[fWindowAxis] * fWindowSide <= 0.) return false;
+  for (G4int axis = 0; axis < 3; axis++) {
+    if (axis == fWindowAxis) continue;
+    if (std::abs(position[axis] - fWindowCentre[axis]) > fWindowHalf[axis]) return false;
+  }
+  return true;
+}
+
+G4bool BoxTracer::Interact(std::size_t i)
+{
+  auto& b = fBatch;
+  if (b.absorption[i] <= 0.f) return false;  // absorbed in the bulk
+
+  // On the wall exactly, whatever the rounding of the step
+  const G4int axis = b.face[i];
+  G4ThreeVector direction(b.dx[i], b.dy[i], b.dz[i]);
+  const G4double side = direction[axis] > 0. ? 1. : -1.;
+  G4float* position[3] = {&b.x[i], &b.y[i], &b.z[i]};
+  *position[axis] = side * fHalf[axis];
+
+  const G4double energy = b.energy[i];
+  if (OnWindow(i)) {
+    const G4double u = G4UniformRand();
+    const G4double reflectivity = ValueOr(fWindowReflectivity, energy, 1.);
+    G4bool enters = true;
+    if (!fWindowSurface || u < reflectivity)
+      enters = Fresnel(direction, axis, energy, b.rindex[i]);
+    else if (u >= reflectivity + ValueOr(fWindowTransmittance, energy, 0.))
+      return false;  // absorbed by the window surface
+    if (enters) {
+      Detect(i);
+      return false;
+    }
+  }
+  else {
+    if (G4UniformRand() >= b.reflectivity[i]) return false;  // absorbed by the paint
+    G4ThreeVector inward;
+    inward[axis] = -side;
+    Reflect(direction, inward, energy);
+  }
+
+  b.dx[i] = direction.x();
+  b.dy[i] = direction.y();
+  b.dz[i] = direction.z();
+  return true;
+}
+
+G4bool BoxTracer::Fresnel(G4ThreeVector& direction, G4int axis, G4double energy,
+                          G4double rindex) const
+{
+  const G4double n1 = rindex;
+  const G4double n2 = fSiPMRindex->Value(energy);
+  const G4double cos1 = std::abs(direction[axis]);
+  const G4double sin2 = n1 / n2 * std::sqrt(std::max(0., 1. - cos1 * cos1));
+  if (sin2 < 1.) {
+    // Unpolarised: the mean of the s and p reflectances
+    const G4double cos2 = std::sqrt(1. - sin2 * sin2);
+    const G4double rs = (n1 * cos1 - n2 * cos2) / (n1 * cos1 + n2 * cos2);
+    const G4double rp = (n2 * cos1 - n1 * cos2) / (n2 * cos1 + n1 * cos2);
+    if (G4UniformRand() >= 0.5 * (rs * rs + rp * rp)) return true;
+  }
+  direction[axis] = -direction[axis];
+  return false;
+}
+
+void BoxTracer::Reflect(G4ThreeVector& direction, const G4ThreeVector& inward,
+                        G4double energy) const
+{
+  if (!fPaintPolished) {
+    // G4OpBoundaryProcess::ChooseReflection
+    const G4double u = G4UniformRand();
+    const G4double spike = ValueOr(fSpike, energy, 0.);
+    const G4double lobe = spike + ValueOr(fLobe, energy, 0.);
+    const G4double back = lobe + ValueOr(fBackScatter, energy, 0.);
+    if (u >= back) {
+      // Lambertian: cos(theta) = sqrt(u) about the normal
+      const G4double cosTheta = std::sqrt(G4UniformRand());
+      const G4double sinTheta = std::sqrt(1. - cosTheta * cosTheta);
+      const G4double phi = twopi * G4UniformRand();
+      direction.set(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+      direction.rotateUz(inward);
+      return;
+    }
+    if (u >= lobe) {
+      direction = -direction;
+      return;
+    }
+    if (u >= spike) {
+      // Specular about a facet, again until it heads back in
+      for (G4int n = 0; n < 100 && direction * inward <= 0.; n++) {
+        const G4ThreeVector facet = FacetNormal(direction, inward);
+        direction = direction - 2. * (direction * facet) * facet;
+      }
+      if (direction * inward > 0.) return;
+    }
+  }
+  direction = direction - 2. * (direction * inward) * inward;
+}
+
+G4ThreeVector BoxTracer::FacetNormal(const G4ThreeVector& direction,
+                                     const G4ThreeVector& inward) const
+{
+  // G4OpBoundaryProcess::GetFacetNormal, unified model
+  if (fSigmaAlpha <= 0.) return inward;
+  const G4double fMax = std::min(1., 4. * fSigmaAlpha);
+  G4ThreeVector facet;
+  do {
+    G4double alpha, sinAlpha;
+    do {
+      alpha = G4RandGauss::shoot(0., fSigmaAlpha);
+      sinAlpha = std::sin(alpha);
+    } while (G4UniformRand() * fMax > sinAlpha || alpha >= halfpi);
+    const G4double phi = twopi * G4UniformRand();
+    facet.set(sinAlpha * std::cos(phi), sinAlpha * std::sin(phi), std::cos(alpha));
+    facet.rotateUz(inward);
+  } while (direction * facet >= 0.);
+  return facet;
+}
+
+void BoxTracer::Detect(std::size_t i)
+{
+  const auto& b = fBatch;
+  if (fMode == Mode::Check) {
+    fEventBox += b.pde[i] * b.weight[i];  // the expectation: less noise to compare
+    return;
+  }
+  if (G4UniformRand() >= b.pde[i]) return;
+  const G4ThreeVector position = fCentre + G4ThreeVector(b.x[i], b.y[i], b.z[i]);
+  // Only reduced-yield survivors have a weight above 1 here
+  fSiPMSD->RecordWeighted(position, b.time[i], b.energy[i], fChannel, b.trackID[i], b.weight[i],
+                          b.weight[i] > 1.f ? &b.origin[i] : nullptr);
+}
+
+void BoxTracer::BeginOfEvent()
+{
+  fBatch.Clear();  // left over from an aborted event
+  fEventBox = 0.;
+}
+
+void BoxTracer::EndOfEvent()
+{
+  if (!fReady) return;
+  fStats.events += 1.;
+  if (fMode != Mode::Check) return;
+  const G4double geant4 = fSiPMSD->GetDetectedCount();
+  fStats.box += fEventBox;
+  fStats.box2 += fEventBox * fEventBox;
+  fStats.geant4 += geant4;
+  fStats.geant42 += geant4 * geant4;
+}
+
+}  // namespace B1
@@ -0,0 +1,369 @@
+// Two-pass simulation: record scintillator deposits, replay selected events
+// Yale Cubesat
+
+#include "DepositReplay.hh"
+
+#include "DepositWriter.hh"
+#include "Log.hh"
+#include "OpticalGovernor.hh"
+#include "OpticalLUT.hh"
+#include "ScintillatorProperties.hh"
+
+#include "G4AutoLock.hh"
+#include "G4Event.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4Material.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4Poisson.hh"
+#include "G4PrimaryParticle.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4ProcessTable.hh"
+#include "G4RandomDirection.hh"
+#include "G4RunManager.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4ios.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <unordered_set>
+
+namespace B1
+{
+
+// deposits.crdh as read back, with the deposits of event i at
+// [first[i], first[i + 1]) of the deposit columns
+struct DepositTable
+{
+  std::vector<std::int32_t> event;
+  std::vector<float> weight, edep, energy;
+  std::vector<std::size_t> first = {0};
+  DepositStore deposits;
+};
+
+// Rows of the table replayed in this run
+struct ReplaySelection
+{
+  std::shared_ptr<const DepositTable> table;
+  std::vector<std::size_t> events;
+};
+
+namespace
+{
+G4Mutex replayMutex = G4MUTEX_INITIALIZER;
+std::map<G4String, std::shared_ptr<const DepositTable>> tableCache;
+
+// Set by the master at the start of the run, shared by the workers
+std::shared_ptr<const ReplaySelection> runSelection;
+std::atomic<std::size_t> nextEvent{0};
+std::atomic<G4bool> exhausted{false};
+
+template <typename T>
+G4bool ReadColumn(std::ifstream& in, std::vector<T>& column, std::int32_t count)
+{
+  const std::size_t offset = column.size();
+  column.resize(offset + count);
+  in.read(reinterpret_cast<char*>(column.data() + offset), count * sizeof(T));
+  return static_cast<G4bool>(in);
+}
+
+std::shared_ptr<const DepositTable> LoadTable(const G4String& fileName)
+{
+  G4AutoLock lock(&replayMutex);
+  auto cached = tableCache.find(fileName);
+  if (cached != tableCache.end()) return cached->second;
+
+  std::ifstream in(fileName, std::ios::binary);
+  if (!in.is_open()) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open deposit file " << fileName << ", nothing to replay.\n"
+        << "Write one with /crd/twopass/mode record first.";
+    G4Exception("DepositReplay::BeginOfRun()", "TwoPass001", JustWarning, msg);
+    return nullptr;
+  }
+
+  char magic[8];
+  std::int32_t reserved[2];
+  std::int64_t sizes[2];
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(reserved), sizeof(reserved));
+  in.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+  G4bool ok = in && std::memcmp(magic, "CRDDEP01", 8) == 0;
+
+  auto table = std::make_shared<DepositTable>();
+  std::vector<std::int32_t> thread, counts;
+  for (std::int64_t group = 0; ok && group < sizes[1]; group++) {
+    std::int32_t header[2];
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    const std::int32_t n = header[0], m = header[1];
+    thread.clear();
+    counts.clear();
+    auto& deposits = table->deposits;
+    ok = in && ReadColumn(in, table->event, n) && ReadColumn(in, thread, n)
+         && ReadColumn(in, counts, n) && ReadColumn(in, table->weight, n)
+         && ReadColumn(in, table->edep, n) && ReadColumn(in, table->energy, n)
+         && ReadColumn(in, deposits.x, m) && ReadColumn(in, deposits.y, m)
+         && ReadColumn(in, deposits.z, m) && ReadColumn(in, deposits.time, m)
+         && ReadColumn(in, deposits.edep, m) && ReadColumn(in, deposits.pdg, m);
+    for (auto count : counts) table->first.push_back(table->first.back() + count);
+  }
+  if (!ok || table->first.back() != table->deposits.Size()) {
+    G4ExceptionDescription msg;
+    msg << fileName << " is not a complete deposit file, nothing to replay.";
+    G4Exception("DepositReplay::BeginOfRun()", "TwoPass002", JustWarning, msg);
+    return nullptr;
+  }
+
+  CRD_INFO(Generator, "[DepositReplay] Loaded " << table->event.size() << " events, "
+         << table->deposits.Size() << " deposits from " << fileName);
+  tableCache[fileName] = table;
+  return table;
+}
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ReplayEventInfo::Print() const
+{
+  G4cout << "Replay of event " << fSourceEvent << " (weight " << fWeight << ", edep "
+         << fEdep / MeV << " MeV, primary " << fPrimaryEnergy / MeV << " MeV)" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+DepositReplay* DepositReplay::Instance()
+{
+  static G4ThreadLocal DepositReplay* instance = nullptr;
+  if (!instance) instance = new DepositReplay();
+  return instance;
+}
+
+DepositReplay::DepositReplay()
+{
+  DefineCommands();
+}
+
+void DepositReplay::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/twopass/", "Two-pass optical simulation");
+
+  auto& modeCmd = fMessenger->DeclareMethod("mode", &DepositReplay::SetMode,
+                                            "off: single pass. "
+                                            "record: no optical photons, energy deposits in "
+                                            "the scintillator written to deposits.crdh. "
+                                            "replay: scintillation light of the selected "
+                                            "events of the deposit file.");
+  modeCmd.SetParameterName("mode", false);
+  modeCmd.SetCandidates("off record replay");
+  modeCmd.SetStates(G4State_Idle);
+
+  auto& fileCmd = fMessenger->DeclareProperty("file", fFileName,
+                                              "Deposit file read by the replay pass.");
+  fileCmd.SetParameterName("file", false);
+
+  auto& eventsCmd = fMessenger->DeclareProperty("events", fEventFile,
+                                                "Replay only the event IDs listed in this "
+                                                "file, one per line (none: no list).");
+  eventsCmd.SetParameterName("file", false);
+
+  auto& edepCmd = fMessenger->DeclarePropertyWithUnit("minEdep", "MeV", fMinEdep,
+                                                      "Replay only events that deposited at "
+                                                      "least this energy.");
+  edepCmd.SetParameterName("edep", false);
+  edepCmd.SetRange("edep>=0.");
+}
+
+void DepositReplay::SetMode(const G4String& mode)
+{
+  fMode = Mode::Off;
+  if (mode == "record") fMode = Mode::Record;
+  if (mode == "replay") fMode = Mode::Replay;
+
+  // The record pass makes no light; otherwise LUT mode has the last word
+  const G4bool optical =
+    fMode != Mode::Record && OpticalLUT::Instance()->GetMode() != OpticalLUT::Mode::Lookup;
+  auto* processTable = G4ProcessTable::GetProcessTable();
+  processTable->SetProcessActivation("Scintillation", optical);
+  processTable->SetProcessActivation("Cerenkov", optical);
+}
+
+std::shared_ptr<const ReplaySelection> DepositReplay::Select() const
+{
+  auto table = LoadTable(fFileName);
+  if (!table) return nullptr;
+
+  const G4bool useList = !fEventFile.empty() && fEventFile != "none";
+  std::unordered_set<G4int> listed;
+  if (useList) {
+    std::ifstream in(fEventFile);
+    if (!in.is_open()) {
+      G4ExceptionDescription msg;
+      msg << "Cannot open event list " << fEventFile << ", nothing to replay.";
+      G4Exception("DepositReplay::Select()", "TwoPass003", JustWarning, msg);
+      return nullptr;
+    }
+    // Lines that do not start with an event ID (headers, comments) are skipped
+    std::string line;
+    while (std::getline(in, line)) {
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::istringstream fields(line);
+      G4int id = 0;
+      if (fields >> id) listed.insert(id);
+    }
+  }
+
+  auto selection = std::make_shared<ReplaySelection>();
+  selection->table = table;
+  for (std::size_t i = 0; i < table->event.size(); i++) {
+    if (table->edep[i] * MeV < fMinEdep) continue;
+    if (useList && listed.count(table->event[i]) == 0) continue;
+    selection->events.push_back(i);
+  }
+
+  CRD_INFO(Generator, "[DepositReplay] " << selection->events.size() << " of "
+         << table->event.size() << " events selected for replay, use /run/beamOn "
+         << selection->events.size() << " or more to replay them all");
+  return selection;
+}
+
+G4bool DepositReplay::LocateScintillator()
+{
+  auto* scintLV = G4LogicalVolumeStore::GetInstance()->GetVolume("Scintillator", false);
+  ScintillatorProperties scintillator;
+  if (!scintLV || !scintillator.Read(scintLV->GetMaterial()) || scintillator.yield <= 0.) {
+    G4Exception("DepositReplay::LocateScintillator()", "TwoPass005", JustWarning,
+                "Scintillator material has no SCINTILLATIONYIELD, nothing to replay.");
+    return false;
+  }
+  fYield = scintillator.yield;
+  fDecayTime = scintillator.decayTime;
+  const auto* spectrum = scintillator.spectrum;
+
+  // Spectrum linear between its points; without one, all photons at the peak
+  fEnergy.clear();
+  fDensity.clear();
+  fCdf.clear();
+  if (!spectrum || spectrum->GetVectorLength() < 2) {
+    fEnergy.push_back(ScintillatorProperties::kPeakEnergy);
+    return true;
+  }
+  fCdf.push_back(0.);
+  for (std::size_t i = 0; i < spectrum->GetVectorLength(); i++) {
+    fEnergy.push_back(spectrum->Energy(i));
+    fDensity.push_back((*spectrum)[i]);
+    if (i == 0) continue;
+    const G4double area = 0.5 * (fDensity[i - 1] + fDensity[i]) * (fEnergy[i] - fEnergy[i - 1]);
+    fCdf.push_back(fCdf.back() + std::max(0., area));
+  }
+  return true;
+}
+
+G4double DepositReplay::SampleEnergy() const
+{
+  if (fCdf.empty() || fCdf.back() <= 0.) return fEnergy.front();
+
+  // Segment, then the inverse of the linear density's integral inside it
+  const G4double target = G4UniformRand() * fCdf.back();
+  const auto it = std::upper_bound(fCdf.begin(), fCdf.end(), target);
+  const std::size_t i = std::clamp<std::size_t>(it - fCdf.begin(), 1, fCdf.size() - 1) - 1;
+  const G4double width = fEnergy[i + 1] - fEnergy[i];
+  const G4double area = fCdf[i + 1] - fCdf[i];
+  if (width <= 0. || area <= 0.) return fEnergy[i];
+
+  // Solve f0 x + (f1 - f0) x^2 / (2 width) = r, in the form that stays
+  // finite for a flat segment
+  const G4double r = target - fCdf[i];
+  const G4double f0 = std::max(0., fDensity[i]);
+  const G4double slope = (std::max(0., fDensity[i + 1]) - f0) / width;
+  const G4double root = std::sqrt(std::max(0., f0 * f0 + 2. * slope * r));
+  const G4double x = (f0 + root > 0.) ? 2. * r / (f0 + root) : 0.;
+  return fEnergy[i] + std::clamp(x, 0., width);
+}
+
+void DepositReplay::BeginOfRun(G4bool isMaster)
+{
+  if (fMode != Mode::Replay) {
+    fSelection.reset();
+    // A new record pass overwrites the file, so tables read before are stale
+    if (fMode == Mode::Record && isMaster) {
+      G4AutoLock lock(&replayMutex);
+      tableCache.clear();
+    }
+    return;
+  }
+
+  if (isMaster) {
+    auto selection = Select();
+    G4AutoLock lock(&replayMutex);
+    runSelection = selection;
+    nextEvent = 0;
+    exhausted = false;
+  }
+  {
+    // In sequential mode the master is also the event loop
+    G4AutoLock lock(&replayMutex);
+    fSelection = runSelection;
+  }
+  if (fSelection && !LocateScintillator()) fSelection.reset();
+}
+
+void DepositReplay::GeneratePrimaries(G4Event* event)
+{
+  const std::size_t next = fSelection ? nextEvent.fetch_add(1) : 0;
+  if (!fSelection || next >= fSelection->events.size()) {
+    if (!exhausted.exchange(true)) {
+      G4Exception("DepositReplay::GeneratePrimaries()", "TwoPass004", JustWarning,
+                  "All selected events have been replayed, ending the run.");
+    }
+    G4RunManager::GetRunManager()->AbortRun(true);
+    return;
+  }
+
+  const auto& table = *fSelection->table;
+  const std::size_t source = fSelection->events[next];
+  const G4double weight = table.weight[source];
+  event->SetUserInformation(new ReplayEventInfo(table.event[source], weight,
+                                                table.edep[source] * MeV,
+                                                table.energy[source] * MeV));
+
+  const auto& deposits = table.deposits;
+  auto* photon = G4OpticalPhoton::Definition();
+  auto* governor = OpticalGovernor::Instance();
+  for (std::size_t i = table.first[source]; i < table.first[source + 1]; i++) {
+    const G4ThreeVector position(deposits.x[i] * mm, deposits.y[i] * mm, deposits.z[i] * mm);
+    const G4long nPhotons = G4Poisson(fYield * deposits.edep[i] * MeV);
+    for (G4long k = 0; k < nPhotons; k++) {
+      G4double time = deposits.time[i] * ns;
+      if (fDecayTime > 0.) time += G4RandExponential::shoot(fDecayTime);
+      governor->AddReplayed(deposits.time[i] * ns);  // reduced yield: copies re-emit
+
+      // Linear polarisation at a random angle around the direction, as in G4Scintillation
+      const G4ThreeVector direction = G4RandomDirection();
+      const G4ThreeVector perp = direction.orthogonal().unit();
+      const G4double phi = twopi * G4UniformRand();
+      const G4ThreeVector polarization =
+        std::cos(phi) * perp + std::sin(phi) * direction.cross(perp);
+
+      auto* particle = new G4PrimaryParticle(photon);
+      particle->SetKineticEnergy(SampleEnergy());
+      particle->SetMomentumDirection(direction);
+      particle->SetPolarization(polarization);
+
+      auto* vertex = new G4PrimaryVertex(position, time);
+      vertex->SetPrimary(particle);
+      vertex->SetWeight(weight);
+      event->AddPrimaryVertex(vertex);
+    }
+  }
+}
+
+}  // namespace B1
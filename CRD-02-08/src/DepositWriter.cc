@@ -0,0 +1,101 @@
+// Scintillator energy deposits of the record pass
+// Yale Cubesat
+
+#include "DepositWriter.hh"
+
+namespace B1
+{
+
+namespace
+{
+template <typename T>
+void WriteColumn(std::ofstream& out, std::vector<T>& column)
+{
+  out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+  column.clear();  // keeps the capacity for the next row group
+}
+
+template <typename T>
+void Extend(std::vector<T>& to, const std::vector<T>& from)
+{
+  to.insert(to.end(), from.begin(), from.end());
+}
+}  // namespace
+
+void DepositWriter::Open(G4int chunkSize)
+{
+  fChunkSize = chunkSize;
+  fCount = 0;
+  fGroups = 0;
+  fFile.open("deposits.crdh", std::ios::binary | std::ios::trunc);
+  if (!fFile.is_open()) {
+    G4Exception("DepositWriter::Open()", "Output006", JustWarning,
+                "Cannot open deposits.crdh, energy deposits will not be written.");
+    return;
+  }
+  WriteHeader();  // counts filled in by Close()
+}
+
+void DepositWriter::WriteHeader()
+{
+  const std::int32_t reserved[2] = {0, 0};
+  const std::int64_t sizes[2] = {fCount, fGroups};
+  fFile.write("CRDDEP01", 8);
+  fFile.write(reinterpret_cast<const char*>(reserved), sizeof(reserved));
+  fFile.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+}
+
+void DepositWriter::Add(const DepositStore& deposits, G4int eventID, G4int thread,
+                        G4double weight, G4double edep, G4double primaryEnergy)
+{
+  if (!fFile.is_open()) return;
+
+  fEvent.push_back(eventID);
+  fThread.push_back(thread);
+  fDeposits.push_back(deposits.Size());
+  fWeight.push_back(weight);
+  fEdep.push_back(edep / MeV);
+  fEnergy.push_back(primaryEnergy / MeV);
+  Extend(fBuffer.x, deposits.x);
+  Extend(fBuffer.y, deposits.y);
+  Extend(fBuffer.z, deposits.z);
+  Extend(fBuffer.time, deposits.time);
+  Extend(fBuffer.edep, deposits.edep);
+  Extend(fBuffer.pdg, deposits.pdg);
+
+  if (static_cast<G4int>(fBuffer.Size()) >= fChunkSize) WriteGroup();
+}
+
+void DepositWriter::WriteGroup()
+{
+  if (fEvent.empty()) return;
+  const std::int32_t header[2] = {static_cast<std::int32_t>(fEvent.size()),
+                                  static_cast<std::int32_t>(fBuffer.Size())};
+  fFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+  fCount += fEvent.size();
+  fGroups++;
+
+  WriteColumn(fFile, fEvent);
+  WriteColumn(fFile, fThread);
+  WriteColumn(fFile, fDeposits);
+  WriteColumn(fFile, fWeight);
+  WriteColumn(fFile, fEdep);
+  WriteColumn(fFile, fEnergy);
+  WriteColumn(fFile, fBuffer.x);
+  WriteColumn(fFile, fBuffer.y);
+  WriteColumn(fFile, fBuffer.z);
+  WriteColumn(fFile, fBuffer.time);
+  WriteColumn(fFile, fBuffer.edep);
+  WriteColumn(fFile, fBuffer.pdg);
+}
+
+void DepositWriter::Close()
+{
+  WriteGroup();
+  if (!fFile.is_open()) return;
+  fFile.seekp(0);
+  WriteHeader();
+  fFile.close();
+}
+
+}  // namespace B1
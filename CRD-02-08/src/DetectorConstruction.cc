@@ -44,7 +44,12 @@
 #include "G4LogicalBorderSurface.hh"
 #include "G4SDManager.hh"
 #include "SiPMSD.hh"
+#include "ScintillatorResponse.hh"
+#include "Log.hh"
 #include "G4LogicalVolumeStore.hh"
+#include "G4FastSimulationManager.hh"
+#include "G4Region.hh"
+#include "G4RegionStore.hh"
 
 
 namespace B1
@@ -113,6 +118,10 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   auto scintillatorPhys = new G4PVPlacement(nullptr, G4ThreeVector(), logicScint, "Scintillator", logicAlShell, false, 0, checkOverlaps);
   logicScint->SetVisAttributes(new G4VisAttributes(G4Colour(1.0, 1.0, 0.0, 0.5)));
 
+  // Envelope of the parameterised scintillator response
+  auto scintRegion = new G4Region("ScintillatorRegion");
+  scintRegion->AddRootLogicalVolume(logicScint);
+
   // Reflective coating on scintillator
   auto paintSurface = new G4OpticalSurface("ReflectivePaint");
   paintSurface->SetType(dielectric_metal);
@@ -152,6 +161,10 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   G4double rindexSiO2[nEntries];
   for (int i=0;i<nEntries;i++) rindexSiO2[i] = 1.46;   // typical fused silica
   mptDet->AddProperty("RINDEX", photonEnergy, rindexSiO2, nEntries);
+  // SiPM photon detection efficiency, read by SiPMSD (onsemi J-series at
+  // 2.5 V overvoltage, approximate datasheet values, 510 to 410 nm)
+  G4double pdeSiPM[nEntries] = { 0.28, 0.30, 0.31, 0.33, 0.34, 0.35, 0.36, 0.37, 0.375, 0.38, 0.38 };
+  mptDet->AddProperty("PDE", photonEnergy, pdeSiPM, nEntries, true);
   detector_mat->SetMaterialPropertiesTable(mptDet);
 
   G4double detector_thickness = 1.0 * mm;
@@ -198,8 +211,8 @@ void DetectorConstruction::ConstructSDandField()
   auto* sipmSD = new SiPMSD("SiPM_SD");
   sdMan->AddNewDetector(sipmSD);
 
-  G4cout << "[DetectorConstruction] Setting SiPM_SD on volume: "
-       << logicDetector->GetName() << G4endl;
+  CRD_INFO(Detector, "[DetectorConstruction] Setting SiPM_SD on volume: "
+       << logicDetector->GetName());
 
   // IMPORTANT: fetch the *thread-local* LV by name (not a stored pointer)
   auto* detLV =
@@ -214,8 +227,16 @@ void DetectorConstruction::ConstructSDandField()
   detLV->SetSensitiveDetector(sipmSD);
 
   // Optional debug
-  G4cout << "[ConstructSDandField] Attached SiPM_SD to LV="
-         << detLV->GetName() << " @ " << detLV << G4endl;
+  CRD_INFO(Detector, "[ConstructSDandField] Attached SiPM_SD to LV="
+         << detLV->GetName() << " @ " << detLV);
+
+  // Parameterised scintillator response, off until
+  // /param/activateModel ScintillatorResponse
+  auto* scintRegion = G4RegionStore::GetInstance()->GetRegion("ScintillatorRegion");
+  auto* responseModel = new ScintillatorResponseModel(scintRegion);
+  scintRegion->GetFastSimulationManager()->InActivateFastSimulationModel(
+      responseModel->GetName());
+  Log::Flush();
 }
 
 
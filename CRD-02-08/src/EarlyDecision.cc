@@ -0,0 +1,183 @@
+// Early end of the optical stage once the SiPM decision is known
+// Yale Cubesat
+
+#include "EarlyDecision.hh"
+
+#include "FrontEnd.hh"
+#include "Log.hh"
+#include "SiPMReadout.hh"
+#include "SiPMSD.hh"
+#include "Trigger.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4SDManager.hh"
+#include "G4Threading.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace B1
+{
+
+void EarlyDecisionStats::Merge(const G4VAccumulable& other)
+{
+  const auto& rhs = static_cast<const EarlyDecisionStats&>(other);
+  events += rhs.events;
+  reached += rhs.reached;
+  hopeless += rhs.hopeless;
+  photons += rhs.photons;
+  skipped += rhs.skipped;
+}
+
+void EarlyDecisionStats::Reset()
+{
+  events = reached = hopeless = photons = skipped = 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EarlyDecision* EarlyDecision::Instance()
+{
+  static G4ThreadLocal EarlyDecision* instance = nullptr;
+  if (!instance) instance = new EarlyDecision();
+  return instance;
+}
+
+EarlyDecision::EarlyDecision()
+{
+  DefineCommands();
+}
+
+void EarlyDecision::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/optical/early/",
+                                      "Stop optical tracking once the SiPM decision is known");
+
+  auto& enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+                                                "Track optical photons after the charged "
+                                                "particles, in random batches, and stop "
+                                                "once the decision level is settled.");
+  enableCmd.SetParameterName("enable", false);
+  enableCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& batchCmd = fMessenger->DeclareProperty("batches", fBatches,
+                                               "Random batches the light is tracked in.");
+  batchCmd.SetParameterName("n", false);
+  batchCmd.SetRange("n>=2 && n<=9");  // the waiting stack and fWaiting_1 to _8
+  batchCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& stopCmd = fMessenger->DeclareProperty("stopAt", fStopAt,
+                                              "Detected photons that settle the decision, "
+                                              "e.g. the saturation level (0: the trigger "
+                                              "photon requirement).");
+  stopCmd.SetParameterName("photons", false);
+  stopCmd.SetRange("photons>=0");
+  stopCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& confidenceCmd = fMessenger->DeclareProperty("confidence", fConfidence,
+                                                    "Standard deviations above the projected "
+                                                    "count before giving up on an event.");
+  confidenceCmd.SetParameterName("z", false);
+  confidenceCmd.SetRange("z>=0.");
+  confidenceCmd.SetStates(G4State_PreInit, G4State_Idle);
+}
+
+G4int EarlyDecision::DecisionLevel() const
+{
+  return fStopAt > 0 ? fStopAt : Trigger::Instance()->GetPhotons();
+}
+
+G4ClassificationOfNewTrack EarlyDecision::ClassifyPhoton() const
+{
+  // Batch 0 is the waiting stack, the others fWaiting_1 onwards
+  const G4int batch = std::min(static_cast<G4int>(G4UniformRand() * fBatches), fBatches - 1);
+  if (batch == 0) return fWaiting;
+  return static_cast<G4ClassificationOfNewTrack>(fWaiting_1 + batch - 1);
+}
+
+G4bool EarlyDecision::NewStage(G4int remaining, G4int next)
+{
+  // First call: the charged particles are done and every photon is stacked
+  if (fTotal < 0) {
+    fTotal = remaining;
+    return false;
+  }
+  fStages++;
+  if (fOutcome != 0) return false;  // the probe is done
+
+  const G4int level = DecisionLevel();
+  const G4long tracked = fTotal - remaining;
+  if (level <= 0 || tracked <= 0 || remaining <= 0) return false;
+
+  if (!fSiPMSD) {
+    fSiPMSD = static_cast<SiPMSD*>(
+      G4SDManager::GetSDMpointer()->FindSensitiveDetector("SiPM_SD", false));
+    if (!fSiPMSD) return false;
+  }
+  const G4double detected = fSiPMSD->GetDetectedCount();
+
+  // The untracked photons are detected at the rate of the tracked ones so
+  // far; the spread is dominated by that rate's Poisson error
+  const G4double ratio = static_cast<G4double>(remaining) / tracked;
+  const G4double upper = detected * (1. + ratio) + fConfidence * ratio * std::sqrt(detected + 1.);
+  if (detected >= level)
+    fOutcome = 1;
+  else if (upper < level)
+    fOutcome = 2;
+  else
+    return false;
+
+  // The next batch, already on the urgent stack, is the probe
+  fDetectedAtStop = detected;
+  fScale = fBatches - fStages;
+  fFraction = static_cast<G4double>(tracked + next) / fTotal;
+  CRD_DEBUG(Optical, "[EarlyDecision] " << (fOutcome == 1 ? "reached " : "cannot reach ")
+         << level << " photons: " << detected << " detected from " << tracked << " of "
+         << fTotal << " optical photons, " << next << " more tracked as the probe");
+  return true;
+}
+
+void EarlyDecision::BeginOfRun()
+{
+  auto* readout = SiPMReadout::Instance();
+  fSuspended = fEnabled && (readout->GetResponse().digitize || readout->GetWaveform().enable
+                            || FrontEnd::Instance()->IsEnabled());
+  if (fSuspended && G4Threading::IsMasterThread()) {
+    G4Exception("EarlyDecision::BeginOfRun()", "EarlyDecision001", JustWarning,
+                "The digitizer, waveforms and front end need all the light: "
+                "early decision is off for this run.");
+  }
+}
+
+void EarlyDecision::BeginOfEvent()
+{
+  fTotal = -1;
+  fFraction = 1.;
+  fOutcome = 0;
+  fStages = 0;
+  fDetectedAtStop = 0.;
+  fScale = 1.;
+}
+
+void EarlyDecision::EndOfEvent()
+{
+  if (!IsEnabled() || fTotal < 0) return;
+  fStats.events += 1.;
+  fStats.photons += fTotal;
+  fStats.skipped += (1. - fFraction) * fTotal;
+  if (fOutcome == 1) fStats.reached += 1.;
+  if (fOutcome == 2) fStats.hopeless += 1.;
+}
+
+void EarlyDecision::EndOfRun() const
+{
+  if (!IsEnabled() || fStats.events <= 0.) return;
+  CRD_INFO(Optical, "[EarlyDecision] " << fStats.events << " events with light: "
+         << fStats.reached << " stopped at the decision level, " << fStats.hopeless
+         << " stopped as out of reach; "
+         << (fStats.photons > 0. ? 100. * fStats.skipped / fStats.photons : 0.)
+         << "% of " << fStats.photons << " optical photons not tracked");
+}
+
+}  // namespace B1
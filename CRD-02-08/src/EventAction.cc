@@ -28,10 +28,27 @@
 // Nikita Mazotov, Yale Cubesat, 01/08/2025
 
 #include "EventAction.hh"
+#include "BoxTracer.hh"
+#include "DepositReplay.hh"
+#include "EarlyDecision.hh"
+#include "FrontEnd.hh"
+#include "OpticalGovernor.hh"
 #include "RunAction.hh"
+#include "OutputThread.hh"
+#include "SiPMHit.hh"
+#include "SiPMReadout.hh"
+#include "SiPMSD.hh"
+#include "Trigger.hh"
 #include "G4Event.hh"
+#include "G4PrimaryParticle.hh"
+#include "G4PrimaryVertex.hh"
 #include "G4RunManager.hh"
+#include "G4SDManager.hh"
+#include "G4Threading.hh"
+#include "G4SystemOfUnits.hh"
 #include "G4ios.hh"
+#include "Log.hh"
+#include <algorithm>
 
 namespace B1
 {
@@ -42,57 +59,259 @@ EventAction::EventAction(RunAction* runAction)
 void EventAction::BeginOfEventAction(const G4Event*)
 {
     fEdep = 0.;
-    fStepHits.clear();
-    fSiPMHits.clear();
-    fMCHits.clear();
+    fPrimaryEntered = false;
+    fStepHits.Clear();
+    fSiPMHits.Clear();
+    fMCHits.Clear();
+    fDeposits.Clear();
+    OpticalGovernor::Instance()->BeginOfEvent();
 
-    G4cout << "[EventAction] BeginOfEventAction: this=" << this
+    CRD_DEBUG(Event, "[EventAction] BeginOfEventAction: this=" << this
            << " fRunAction=" << fRunAction
-           << " (stepHits=" << fStepHits.size()
-           << " sipm=" << fSiPMHits.size()
-           << " mc=" << fMCHits.size() << ")" << G4endl;
+           << " (stepHits=" << fStepHits.Size()
+           << " sipm=" << fSiPMHits.Size()
+           << " mc=" << fMCHits.Size() << ")");
 }
 
-void EventAction::EndOfEventAction(const G4Event*)
+void EventAction::EndOfEventAction(const G4Event* event)
 {
-    G4cout << "[EventAction] EndOfEventAction: this=" << this
-           << " before merge: stepHits=" << fStepHits.size()
-           << " sipmHits=" << fSiPMHits.size()
-           << " mcHits=" << fMCHits.size()
-           << " fRunAction=" << fRunAction << G4endl;
+    OpticalGovernor::Instance()->EndOfEvent(event->GetEventID());
+    EarlyDecision::Instance()->EndOfEvent();
+    BoxTracer::Instance()->EndOfEvent();
+
+    // SiPM hits from the sensitive detector, looked up by collection ID
+    if (fSiPMHCID < 0)
+        fSiPMHCID = G4SDManager::GetSDMpointer()->GetCollectionID("SiPM_SD/SiPMHitsCollection");
+    auto* hce = event->GetHCofThisEvent();
+    auto* readout = SiPMReadout::Instance();
+    const G4bool histogramMode = readout->GetMode() == SiPMReadout::Mode::Histogram;
+    if (histogramMode && !fSiPMSD) {
+        fSiPMSD = static_cast<SiPMSD*>(
+            G4SDManager::GetSDMpointer()->FindSensitiveDetector("SiPM_SD", false));
+    }
+    const TimeHistogram* histogram = histogramMode && fSiPMSD ? &fSiPMSD->GetTimeHistogram() : nullptr;
+
+    G4double primaryWeight = event->GetPrimaryVertex() ? event->GetPrimaryVertex()->GetWeight() : 1.;
+
+    // Two-pass workflow. A replayed event stands for its recorded event,
+    // whose deposit (the photons make none) and weight it takes; events
+    // generated after the selection ran out are empty and not counted.
+    const auto twoPass = DepositReplay::Instance()->GetMode();
+    const auto* replayInfo = twoPass == DepositReplay::Mode::Replay
+        ? static_cast<const ReplayEventInfo*>(event->GetUserInformation()) : nullptr;
+    if (twoPass == DepositReplay::Mode::Replay && !replayInfo) {
+        fStepHits.Clear();
+        fMCHits.Clear();
+        Log::Flush();
+        return;
+    }
+    if (replayInfo) {
+        fEdep = replayInfo->GetEdep();
+        primaryWeight = replayInfo->GetWeight();
+    }
 
     // If we have an owned RunAction pointer, use it.
-    if (fRunAction) {
-        fRunAction->AddEdep(fEdep);
-        if (!fStepHits.empty()) fRunAction->MergeStepHits(fStepHits);
-        if (!fSiPMHits.empty()) fRunAction->MergeSiPMHits(fSiPMHits);
-        if (!fMCHits.empty()) fRunAction->MergeMCHits(fMCHits);
-    } else {
-        // Fallback: try to fetch RunAction from the RunManager and call merges.
+    RunAction* runAction = fRunAction;
+    if (!runAction) {
+        // Fallback: try to fetch RunAction from the RunManager.
         auto* urun = G4RunManager::GetRunManager()->GetUserRunAction();
         if (urun) {
             // safe cast through const to avoid "casts away qualifiers" warnings
-            auto* runAction = const_cast<RunAction*>(
-                static_cast<const RunAction*>(urun));
+            runAction = const_cast<RunAction*>(static_cast<const RunAction*>(urun));
             if (runAction) {
-                G4cout << "[EventAction] fRunAction was null — using RunManager fallback: "
-                       << runAction << G4endl;
-                runAction->AddEdep(fEdep);
-                if (!fStepHits.empty()) runAction->MergeStepHits(fStepHits);
-                if (!fSiPMHits.empty()) runAction->MergeSiPMHits(fSiPMHits);
-                if (!fMCHits.empty()) runAction->MergeMCHits(fMCHits);
+                CRD_WARN(Event, "[EventAction] fRunAction was null — using RunManager fallback: "
+                       << runAction);
             } else {
-                G4cout << "[EventAction] WARNING: fallback runAction cast failed." << G4endl;
+                CRD_WARN(Event, "[EventAction] WARNING: fallback runAction cast failed.");
             }
         } else {
-            G4cout << "[EventAction] WARNING: no RunAction available to merge into." << G4endl;
+            CRD_WARN(Event, "[EventAction] WARNING: no RunAction available to merge into.");
         }
     }
 
+    // Trigger before anything is merged: a rejected event stops at the counters
+    auto* hc = hce && fSiPMHCID >= 0 ? static_cast<SiPMHitsCollection*>(hce->GetHC(fSiPMHCID))
+                                     : nullptr;
+    auto* trigger = Trigger::Instance();
+    const G4bool accepted = histogram ? trigger->Accept(fEdep, *histogram, fTriggerBins)
+                                      : trigger->Accept(fEdep, hc, fTimes);
+    if (runAction) {
+        runAction->AddEdep(fEdep);
+        runAction->AddPrimaryWeight(primaryWeight);
+        runAction->CountTrigger(accepted, primaryWeight);
+    }
+    // The record pass keeps every event with deposits: the replay selects
+    const G4bool recordDeposits = twoPass == DepositReplay::Mode::Record && !fDeposits.Empty();
+    if (!accepted && !trigger->GetPersistAll() && !recordDeposits) {
+        CRD_DEBUG(Event, "[EventAction] event " << event->GetEventID() << " not triggered");
+        fStepHits.Clear();
+        fMCHits.Clear();
+        fDeposits.Clear();
+        Log::Flush();
+        return;
+    }
+
+    if (hc) {
+        for (size_t i = 0; i < hc->entries(); i++) {
+            const auto* hit = (*hc)[i];
+            fSiPMHits.Add(hit->GetPosition(), hit->GetTime(), hit->GetEnergy(),
+                          hit->GetChannel(), hit->GetTrackID());
+        }
+    }
+
+    CRD_DEBUG(Event, "[EventAction] EndOfEventAction: this=" << this
+           << " before merge: stepHits=" << fStepHits.Size()
+           << " sipmHits=" << fSiPMHits.Size()
+           << " mcHits=" << fMCHits.Size()
+           << " fRunAction=" << fRunAction);
+
+    // One summary row per written event; raw hits only ride along if asked for.
+    // Swapping with a recycled record moves them without copying and
+    // leaves grown, empty columns here.
+    auto* output = OutputThread::Instance();
+    auto record = output->AcquireRecord();
+    record->eventID = replayInfo ? replayInfo->GetSourceEvent() : event->GetEventID();
+    record->thread = G4Threading::G4GetThreadId();
+    FillSummary(event, accepted, histogram, record->summary);
+    if (replayInfo) {
+        // The recorded primary, not the photons of this event
+        auto& summary = record->summary;
+        summary.weight = replayInfo->GetWeight();
+        summary.primaryEnergy = replayInfo->GetPrimaryEnergy();
+        summary.primaryDirection = G4ThreeVector();
+        summary.entered = false;
+        summary.entryPoint = G4ThreeVector();
+    }
+
+    // Histogram readout: the non-empty bins stand in for the SiPM hits
+    record->hasTimeHistogram = histogram != nullptr;
+    if (histogram) {
+        auto& sparse = record->timeHistogram;
+        sparse.total = histogram->GetTotal();
+        sparse.overflow = histogram->GetOverflow();
+        histogram->GetNonZero(sparse.bin, sparse.count);
+    }
+
+    // Microcell response to the detected photons (and dark counts)
+    const auto& response = readout->GetResponse();
+    if (response.digitize) {
+        if (histogram) {
+            const auto& sparse = record->timeHistogram;
+            const G4double width = histogram->GetBinWidth();
+            for (size_t i = 0; i < sparse.bin.size(); i++)
+                fDigitizer.AddPhotons(sparse.bin[i] * width, width, sparse.count[i]);
+        } else {
+            for (auto time : fSiPMHits.time) fDigitizer.AddPhoton(time * ns);
+        }
+        auto& signal = record->summary.signal;
+        fDigitizer.Digitize(response, signal);
+        record->summary.digitized = true;
+        CRD_DEBUG(Event, "[EventAction] SiPM signal: " << signal.charge << " p.e. in "
+               << signal.firedCells << " cells (dark " << signal.darkCounts
+               << ", crosstalk " << signal.crosstalk << ", afterpulses " << signal.afterpulses
+               << ")");
+    }
+
+    // Pulse trains for the waveform and the front end: the digitized
+    // avalanches, else the photons
+    const auto& wave = readout->GetWaveform();
+    if (wave.enable) {
+        FillPulseTrain(record->pulseTrain, wave.period, wave.samples, response.digitize,
+                       histogram ? &record->timeHistogram : nullptr, histogram);
+    }
+    auto* frontEnd = FrontEnd::Instance();
+    if (frontEnd->IsEnabled()) {
+        FillPulseTrain(fShaperTrain, frontEnd->GetPeriod(), frontEnd->GetSamples(),
+                       response.digitize, histogram ? &record->timeHistogram : nullptr,
+                       histogram);
+        frontEnd->Record(frontEnd->Shape(fShaperTrain), primaryWeight);
+    }
+
+    if (output->GetRecordHits()) {
+        record->hits[static_cast<G4int>(HitType::SiPM)].Swap(fSiPMHits);
+        record->hits[static_cast<G4int>(HitType::MC)].Swap(fMCHits);
+    }
+    if (output->GetRecordStepHits())
+        record->hits[static_cast<G4int>(HitType::Step)].Swap(fStepHits);
+    if (recordDeposits) record->deposits.Swap(fDeposits);
+    output->Submit(std::move(record));
+
     // Clear event-local buffers
-    fStepHits.clear();
-    fSiPMHits.clear();
-    fMCHits.clear();
+    fStepHits.Clear();
+    fSiPMHits.Clear();
+    fMCHits.Clear();
+    fDeposits.Clear();
+
+    Log::Flush();
+}
+
+void EventAction::FillPulseTrain(std::vector<float>& train, G4double period, G4int samples,
+                                 G4bool digitized, const SparseTimeHistogram* sparse,
+                                 const TimeHistogram* histogram) const
+{
+    train.assign(samples, 0.f);
+    if (digitized) {
+        for (const auto& pulse : fDigitizer.GetPulses())
+            AddToTrain(train, pulse.time / period, pulse.charge);
+    } else if (sparse && histogram) {
+        const G4double width = histogram->GetBinWidth();
+        for (size_t i = 0; i < sparse->bin.size(); i++)
+            AddToTrain(train, (sparse->bin[i] + 0.5) * width / period, sparse->count[i]);
+    } else {
+        for (auto time : fSiPMHits.time) AddToTrain(train, time * ns / period, 1.);
+    }
+}
+
+void EventAction::AddToTrain(std::vector<float>& train, G4double sample, G4double charge)
+{
+    // Shared linearly between the two samples either side
+    if (sample < 0. || sample >= train.size()) return;
+    const auto i = static_cast<size_t>(sample);
+    const G4double f = sample - i;
+    train[i] += (1. - f) * charge;
+    if (i + 1 < train.size()) train[i + 1] += f * charge;
+}
+
+void EventAction::FillSummary(const G4Event* event, G4bool triggered,
+                              const TimeHistogram* histogram, EventSummary& summary)
+{
+    summary = EventSummary();
+    if (auto* vertex = event->GetPrimaryVertex()) {
+        summary.weight = vertex->GetWeight();
+        if (auto* primary = vertex->GetPrimary()) {
+            summary.primaryEnergy = primary->GetKineticEnergy();
+            summary.primaryDirection = primary->GetMomentumDirection();
+        }
+    }
+    summary.entryPoint = fPrimaryEntry;
+    summary.entered = fPrimaryEntered;
+    summary.edep = fEdep;
+    summary.triggered = triggered;
+    summary.tracked = EarlyDecision::Instance()->GetTrackedFraction();
+    summary.yieldFactor = OpticalGovernor::Instance()->GetYieldFactor();
+    summary.photons = histogram ? histogram->GetTotal() : fSiPMHits.time.size();
+    summary.estimate = EarlyDecision::Instance()->EstimateDetected(summary.photons);
+
+    if (histogram) {
+        if (summary.photons == 0) return;
+        summary.firstTime = histogram->GetFirstTime();
+        if (histogram->GetTotal() > histogram->GetOverflow())
+            summary.medianTime = histogram->GetMedianTime();
+        return;
+    }
+
+    // Arrival times: first and median of the detected photons
+    const auto& times = fSiPMHits.time;
+    if (times.empty()) return;
+
+    summary.firstTime = *std::min_element(times.begin(), times.end()) * ns;
+    fTimes.assign(times.begin(), times.end());
+    auto middle = fTimes.begin() + fTimes.size() / 2;
+    std::nth_element(fTimes.begin(), middle, fTimes.end());
+    G4double median = *middle;
+    if (fTimes.size() % 2 == 0)
+        median = 0.5 * (median + *std::max_element(fTimes.begin(), middle));
+    summary.medianTime = median * ns;
 }
 
 } // namespace B1
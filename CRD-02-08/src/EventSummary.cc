@@ -0,0 +1,118 @@
+// Per-event summary rows
+// Yale Cubesat
+
+#include "EventSummary.hh"
+
+#include "G4SystemOfUnits.hh"
+
+#include <limits>
+
+namespace B1
+{
+
+namespace
+{
+const float noValue = std::numeric_limits<float>::quiet_NaN();
+
+template <typename T>
+void WriteColumn(std::ofstream& out, std::vector<T>& column)
+{
+  out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+  column.clear();  // keeps the capacity for the next row group
+}
+
+void WriteHeader(std::ofstream& out, G4long rows, G4long groups)
+{
+  const std::int32_t reserved[2] = {0, 0};
+  const std::int64_t sizes[2] = {rows, groups};
+  out.write("CRDEVT05", 8);
+  out.write(reinterpret_cast<const char*>(reserved), sizeof(reserved));
+  out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+}
+}  // namespace
+
+void SummaryWriter::Open(G4int chunkSize)
+{
+  fChunkSize = chunkSize;
+  fCount = 0;
+  fGroups = 0;
+  fFile.open("events.crdh", std::ios::binary | std::ios::trunc);
+  if (!fFile.is_open()) {
+    G4Exception("SummaryWriter::Open()", "Output002", JustWarning,
+                "Cannot open events.crdh, event summaries will not be written.");
+    return;
+  }
+  WriteHeader(fFile, 0, 0);  // counts filled in by Close()
+}
+
+void SummaryWriter::Add(const EventSummary& summary, G4int eventID, G4int thread)
+{
+  if (!fFile.is_open()) return;
+
+  fEvent.push_back(eventID);
+  fThread.push_back(thread);
+  fEnergy.push_back(summary.primaryEnergy / MeV);
+  fDirX.push_back(summary.primaryDirection.x());
+  fDirY.push_back(summary.primaryDirection.y());
+  fDirZ.push_back(summary.primaryDirection.z());
+  fEntryX.push_back(summary.entered ? summary.entryPoint.x() / mm : noValue);
+  fEntryY.push_back(summary.entered ? summary.entryPoint.y() / mm : noValue);
+  fEntryZ.push_back(summary.entered ? summary.entryPoint.z() / mm : noValue);
+  fEdep.push_back(summary.edep / MeV);
+  fWeight.push_back(summary.weight);
+  fPhotons.push_back(summary.photons);
+  fTracked.push_back(summary.tracked);
+  fEstimate.push_back(summary.estimate);
+  fYieldFactor.push_back(summary.yieldFactor);
+  fFirstTime.push_back(summary.photons > 0 ? summary.firstTime / ns : noValue);
+  fMedianTime.push_back(summary.photons > 0 ? summary.medianTime / ns : noValue);
+  const auto& signal = summary.signal;
+  fCharge.push_back(summary.digitized ? signal.charge : noValue);
+  fFiredCells.push_back(signal.firedCells);
+  fSignalTime.push_back(summary.digitized && signal.timed ? signal.time / ns : noValue);
+  fTriggered.push_back(summary.triggered);
+
+  if (static_cast<G4int>(fEvent.size()) >= fChunkSize) WriteGroup();
+}
+
+void SummaryWriter::WriteGroup()
+{
+  if (fEvent.empty()) return;
+  const std::int32_t header[2] = {static_cast<std::int32_t>(fEvent.size()), 0};
+  fFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+  fCount += fEvent.size();
+  fGroups++;
+
+  WriteColumn(fFile, fEvent);
+  WriteColumn(fFile, fThread);
+  WriteColumn(fFile, fEnergy);
+  WriteColumn(fFile, fDirX);
+  WriteColumn(fFile, fDirY);
+  WriteColumn(fFile, fDirZ);
+  WriteColumn(fFile, fEntryX);
+  WriteColumn(fFile, fEntryY);
+  WriteColumn(fFile, fEntryZ);
+  WriteColumn(fFile, fEdep);
+  WriteColumn(fFile, fWeight);
+  WriteColumn(fFile, fPhotons);
+  WriteColumn(fFile, fTracked);
+  WriteColumn(fFile, fEstimate);
+  WriteColumn(fFile, fYieldFactor);
+  WriteColumn(fFile, fFirstTime);
+  WriteColumn(fFile, fMedianTime);
+  WriteColumn(fFile, fCharge);
+  WriteColumn(fFile, fFiredCells);
+  WriteColumn(fFile, fSignalTime);
+  WriteColumn(fFile, fTriggered);
+}
+
+void SummaryWriter::Close()
+{
+  WriteGroup();
+  if (!fFile.is_open()) return;
+  fFile.seekp(0);
+  WriteHeader(fFile, fCount, fGroups);
+  fFile.close();
+}
+
+}  // namespace B1
@@ -0,0 +1,69 @@
+// Radix-2 complex FFT
+// Yale Cubesat
+
+#include "FFT.hh"
+
+#include "G4PhysicalConstants.hh"
+
+#include <cmath>
+#include <utility>
+
+namespace B1
+{
+
+std::size_t FFT::NextPowerOfTwo(std::size_t n)
+{
+  std::size_t size = 1;
+  while (size < n) size <<= 1;
+  return size;
+}
+
+FFT::FFT(std::size_t size) : fSize(NextPowerOfTwo(size))
+{
+  G4int bits = 0;
+  while ((std::size_t(1) << bits) < fSize) bits++;
+  for (std::size_t i = 0; i < fSize; i++) {
+    std::size_t j = 0;
+    for (G4int b = 0; b < bits; b++) j |= ((i >> b) & 1) << (bits - 1 - b);
+    if (i < j) {
+      fSwap.push_back(i);
+      fSwap.push_back(j);
+    }
+  }
+
+  fTwiddle.resize(fSize / 2);
+  for (std::size_t k = 0; k < fSize / 2; k++)
+    fTwiddle[k] = std::polar(1., -twopi * k / fSize);
+}
+
+void FFT::Forward(std::complex<G4double>* data, std::size_t count) const
+{
+  Transform(data, count, false);
+}
+
+void FFT::Inverse(std::complex<G4double>* data, std::size_t count) const
+{
+  Transform(data, count, true);
+}
+
+void FFT::Transform(std::complex<G4double>* data, std::size_t count, G4bool inverse) const
+{
+  for (std::size_t c = 0; c < count; c++, data += fSize) {
+    for (std::size_t i = 0; i < fSwap.size(); i += 2) std::swap(data[fSwap[i]], data[fSwap[i + 1]]);
+
+    for (std::size_t half = 1; half < fSize; half <<= 1) {
+      const std::size_t stride = fSize / (2 * half);
+      for (std::size_t start = 0; start < fSize; start += 2 * half) {
+        for (std::size_t k = 0; k < half; k++) {
+          auto w = fTwiddle[k * stride];
+          if (inverse) w = std::conj(w);
+          const auto t = w * data[start + k + half];
+          data[start + k + half] = data[start + k] - t;
+          data[start + k] += t;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace B1
@@ -0,0 +1,192 @@
+// Front-end shaper and threshold discriminators
+// Yale Cubesat
+
+#include "FrontEnd.hh"
+
+#include "DataLogger.hh"
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+#include "Log.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace B1
+{
+
+void ThresholdSpectrum::Configure(const std::vector<G4double>& thresholds)
+{
+  fThresholds = thresholds;
+  Reset();
+}
+
+void ThresholdSpectrum::Merge(const G4VAccumulable& other)
+{
+  const auto& rhs = static_cast<const ThresholdSpectrum&>(other);
+  if (rhs.fIntegral.size() != fIntegral.size()) return;
+  for (size_t i = 0; i < fIntegral.size(); i++) {
+    fIntegral[i] += rhs.fIntegral[i];
+    fDifferential[i] += rhs.fDifferential[i];
+  }
+}
+
+void ThresholdSpectrum::Reset()
+{
+  fIntegral.assign(fThresholds.size(), 0.);
+  fDifferential.assign(fThresholds.size(), 0.);
+}
+
+void ThresholdSpectrum::Fill(G4double amplitude, G4double weight)
+{
+  // Thresholds crossed are the ones up to the first above the amplitude
+  const auto crossed = std::upper_bound(fThresholds.begin(), fThresholds.end(), amplitude)
+                       - fThresholds.begin();
+  if (crossed == 0) return;
+  for (G4int i = 0; i < crossed; i++) fIntegral[i] += weight;
+  fDifferential[crossed - 1] += weight;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+FrontEnd* FrontEnd::Instance()
+{
+  static G4ThreadLocal FrontEnd* instance = nullptr;
+  if (!instance) instance = new FrontEnd();
+  return instance;
+}
+
+FrontEnd::FrontEnd()
+  : fPeriod(1. * ns),
+    fWindow(500. * ns),
+    fDifferentiation(50. * ns),
+    fIntegration(50. * ns),
+    fGain(1e-3 * volt),
+    fThresholds({1. * volt, 2. * volt, 3. * volt, 4. * volt, 5. * volt})
+{
+  DefineCommands();
+}
+
+void FrontEnd::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/frontend/", "Front-end shaper and discriminators");
+
+  auto& enableCmd = fMessenger->DeclareProperty("enable", fEnabled,
+                                                "Shape every event and count it against "
+                                                "the discriminator thresholds.");
+  enableCmd.SetParameterName("enable", false);
+  enableCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& crCmd = fMessenger->DeclarePropertyWithUnit("differentiation", "ns", fDifferentiation,
+                                                    "CR (high-pass) time constant.");
+  crCmd.SetParameterName("tau", false);
+  crCmd.SetRange("tau>0.");
+  crCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& rcCmd = fMessenger->DeclarePropertyWithUnit("integration", "ns", fIntegration,
+                                                    "RC (low-pass) time constant.");
+  rcCmd.SetParameterName("tau", false);
+  rcCmd.SetRange("tau>0.");
+  rcCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& gainCmd = fMessenger->DeclarePropertyWithUnit("gain", "V", fGain,
+                                                      "Shaped peak height of a single p.e.");
+  gainCmd.SetParameterName("height", false);
+  gainCmd.SetRange("height>0.");
+  gainCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& periodCmd = fMessenger->DeclarePropertyWithUnit("period", "ns", fPeriod,
+                                                        "Filter sample spacing.");
+  periodCmd.SetParameterName("period", false);
+  periodCmd.SetRange("period>0.");
+  periodCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& windowCmd = fMessenger->DeclarePropertyWithUnit("window", "ns", fWindow,
+                                                        "Time from the primary vertex over "
+                                                        "which the peak is searched.");
+  windowCmd.SetParameterName("window", false);
+  windowCmd.SetRange("window>0.");
+  windowCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& thresholdCmd = fMessenger->DeclareMethod("thresholds", &FrontEnd::SetThresholds,
+                                                 "Discriminator thresholds in V, "
+                                                 "e.g. \"2 3 4 5\".");
+  thresholdCmd.SetParameterName("volts", false);
+  thresholdCmd.SetStates(G4State_PreInit, G4State_Idle);
+}
+
+void FrontEnd::SetThresholds(const G4String& list)
+{
+  std::istringstream in(list);
+  std::vector<G4double> thresholds;
+  G4double value = 0.;
+  while (in >> value) thresholds.push_back(value * volt);
+  if (thresholds.empty()) {
+    G4Exception("FrontEnd::SetThresholds()", "FrontEnd001", JustWarning,
+                "No thresholds given, keeping the current ones.");
+    return;
+  }
+  std::sort(thresholds.begin(), thresholds.end());
+  thresholds.erase(std::unique(thresholds.begin(), thresholds.end()), thresholds.end());
+  fThresholds = thresholds;
+}
+
+G4int FrontEnd::GetSamples() const
+{
+  return std::max(1, static_cast<G4int>(std::ceil(fWindow / fPeriod)));
+}
+
+void FrontEnd::BeginOfRun()
+{
+  fSpectrum.Configure(fThresholds);
+
+  // A single p.e. in the first sample sets the scale to volts
+  std::vector<float> impulse(GetSamples(), 0.f);
+  impulse[0] = 1.f;
+  const G4double peak = Peak(impulse);
+  fScale = peak > 0. ? fGain / peak : 0.;
+}
+
+G4double FrontEnd::Peak(const std::vector<float>& train) const
+{
+  const G4double cr = fDifferentiation / (fDifferentiation + fPeriod);
+  const G4double rc = fPeriod / (fIntegration + fPeriod);
+  G4double input = 0., highPass = 0., lowPass = 0., peak = 0.;
+  for (auto x : train) {
+    highPass = cr * (highPass + x - input);
+    input = x;
+    lowPass += rc * (highPass - lowPass);
+    peak = std::max(peak, lowPass);
+  }
+  return peak;
+}
+
+G4double FrontEnd::Shape(const std::vector<float>& train) const
+{
+  return fScale * Peak(train);
+}
+
+void FrontEnd::EndOfRun()
+{
+  if (!fEnabled) return;
+
+  // Flight data order: highest threshold first
+  const auto& thresholds = fSpectrum.GetThresholds();
+  const auto& integral = fSpectrum.GetIntegral();
+  const auto& differential = fSpectrum.GetDifferential();
+
+  CsvLogger counts("threshold_counts");
+  CsvLogger binned("threshold_counts_binned");
+  counts.WriteRow("voltage", "counts");
+  binned.WriteRow("voltage", "counts");
+  for (size_t i = thresholds.size(); i-- > 0;) {
+    counts.WriteRow(thresholds[i] / volt, integral[i]);
+    binned.WriteRow(thresholds[i] / volt, differential[i]);
+  }
+
+  CRD_INFO(Run, "[FrontEnd] " << (integral.empty() ? 0. : integral.front())
+         << " events over the lowest threshold, spectra in " << counts.GetFilename()
+         << " and " << binned.GetFilename());
+}
+
+}  // namespace B1
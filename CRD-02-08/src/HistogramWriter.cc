@@ -0,0 +1,90 @@
+// Per-event SiPM arrival-time histograms
+// Yale Cubesat
+
+#include "HistogramWriter.hh"
+
+#include "G4SystemOfUnits.hh"
+
+namespace B1
+{
+
+namespace
+{
+template <typename T>
+void WriteColumn(std::ofstream& out, std::vector<T>& column)
+{
+  out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+  column.clear();  // keeps the capacity for the next row group
+}
+}  // namespace
+
+void HistogramWriter::Open(G4int chunkSize, G4double binWidth, G4int nBins)
+{
+  fChunkSize = chunkSize;
+  fBinWidth = binWidth;
+  fBins = nBins;
+  fCount = 0;
+  fGroups = 0;
+  fFile.open("sipm_histograms.crdh", std::ios::binary | std::ios::trunc);
+  if (!fFile.is_open()) {
+    G4Exception("HistogramWriter::Open()", "Output003", JustWarning,
+                "Cannot open sipm_histograms.crdh, time histograms will not be written.");
+    return;
+  }
+  WriteHeader();  // counts filled in by Close()
+}
+
+void HistogramWriter::WriteHeader()
+{
+  const float binWidth = fBinWidth / ns;
+  const std::int32_t bins = fBins;
+  const std::int64_t sizes[2] = {fCount, fGroups};
+  fFile.write("CRDTHS01", 8);
+  fFile.write(reinterpret_cast<const char*>(&binWidth), sizeof(binWidth));
+  fFile.write(reinterpret_cast<const char*>(&bins), sizeof(bins));
+  fFile.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+}
+
+void HistogramWriter::Add(const SparseTimeHistogram& histogram, G4int eventID, G4int thread)
+{
+  if (!fFile.is_open()) return;
+
+  fEvent.push_back(eventID);
+  fThread.push_back(thread);
+  fPhotons.push_back(histogram.total);
+  fOverflow.push_back(histogram.overflow);
+  fEntries.push_back(histogram.bin.size());
+  fBin.insert(fBin.end(), histogram.bin.begin(), histogram.bin.end());
+  fBinCount.insert(fBinCount.end(), histogram.count.begin(), histogram.count.end());
+
+  if (static_cast<G4int>(fEvent.size()) >= fChunkSize) WriteGroup();
+}
+
+void HistogramWriter::WriteGroup()
+{
+  if (fEvent.empty()) return;
+  const std::int32_t header[2] = {static_cast<std::int32_t>(fEvent.size()),
+                                  static_cast<std::int32_t>(fBin.size())};
+  fFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+  fCount += fEvent.size();
+  fGroups++;
+
+  WriteColumn(fFile, fEvent);
+  WriteColumn(fFile, fThread);
+  WriteColumn(fFile, fPhotons);
+  WriteColumn(fFile, fOverflow);
+  WriteColumn(fFile, fEntries);
+  WriteColumn(fFile, fBin);
+  WriteColumn(fFile, fBinCount);
+}
+
+void HistogramWriter::Close()
+{
+  WriteGroup();
+  if (!fFile.is_open()) return;
+  fFile.seekp(0);
+  WriteHeader();
+  fFile.close();
+}
+
+}  // namespace B1
@@ -0,0 +1,94 @@
+// Binary columnar hit files
+// Yale Cubesat
+
+#include "HitWriter.hh"
+
+namespace B1
+{
+
+namespace
+{
+const char* typeLabel[] = {"sipm", "mc", "step"};
+
+template <typename T>
+void WriteColumn(std::ofstream& out, const std::vector<T>& column)
+{
+  out.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+}
+
+void WriteHeader(std::ofstream& out, G4int type, G4long rows, G4long groups)
+{
+  const std::int32_t header[2] = {type, 0};
+  const std::int64_t sizes[2] = {rows, groups};
+  out.write("CRDHITS2", 8);
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+}
+}  // namespace
+
+void HitWriter::Open(G4int chunkSize)
+{
+  fChunkSize = chunkSize;
+  for (G4int type = 0; type < kHitTypes; type++) {
+    fBuffer[type].clear();
+    fCount[type] = 0;
+    fGroups[type] = 0;
+
+    G4String fileName = G4String("hits_") + typeLabel[type] + ".crdh";
+    fFile[type].open(fileName, std::ios::binary | std::ios::trunc);
+    if (!fFile[type].is_open()) {
+      G4ExceptionDescription msg;
+      msg << "Cannot open " << fileName << ", these hits will not be written.";
+      G4Exception("HitWriter::Open()", "Output001", JustWarning, msg);
+      continue;
+    }
+    WriteHeader(fFile[type], type, 0, 0);  // counts filled in by Close()
+  }
+}
+
+void HitWriter::Add(HitType type, const HitStore& hits, G4int eventID, G4int thread)
+{
+  const G4int i = static_cast<G4int>(type);
+  auto& buffer = fBuffer[i][thread];
+  buffer.hits.Append(hits);
+  buffer.event.insert(buffer.event.end(), hits.Size(), eventID);
+  if (static_cast<G4int>(buffer.hits.Size()) >= fChunkSize) WriteGroup(i, thread, buffer);
+}
+
+void HitWriter::WriteGroup(G4int type, G4int thread, Buffer& buffer)
+{
+  const auto& hits = buffer.hits;
+  if (hits.Empty()) return;
+
+  auto& out = fFile[type];
+  if (out.is_open()) {
+    const std::int32_t header[2] = {static_cast<std::int32_t>(hits.Size()), thread};
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    WriteColumn(out, hits.x);
+    WriteColumn(out, hits.y);
+    WriteColumn(out, hits.z);
+    WriteColumn(out, hits.time);
+    WriteColumn(out, hits.energy);
+    WriteColumn(out, hits.channel);
+    WriteColumn(out, hits.track);
+    WriteColumn(out, buffer.event);
+    fCount[type] += hits.Size();
+    fGroups[type]++;
+  }
+  // Clear() keeps the capacity for the next row group
+  buffer.hits.Clear();
+  buffer.event.clear();
+}
+
+void HitWriter::Close()
+{
+  for (G4int type = 0; type < kHitTypes; type++) {
+    for (auto& [thread, buffer] : fBuffer[type]) WriteGroup(type, thread, buffer);
+    if (!fFile[type].is_open()) continue;
+    fFile[type].seekp(0);
+    WriteHeader(fFile[type], type, fCount[type], fGroups[type]);
+    fFile[type].close();
+  }
+}
+
+}  // namespace B1
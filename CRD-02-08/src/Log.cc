@@ -0,0 +1,132 @@
+// Levelled, per-component logging for the hot paths
+// Yale Cubesat
+
+#include "Log.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4ios.hh"
+
+#include <string>
+
+namespace B1
+{
+
+std::atomic<G4int> Log::fLevels[static_cast<G4int>(LogCategory::Count)] = {
+  {static_cast<G4int>(LogLevel::Warning)},  // SD
+  {static_cast<G4int>(LogLevel::Warning)},  // Event
+  {static_cast<G4int>(LogLevel::Info)},     // Run
+  {static_cast<G4int>(LogLevel::Info)},     // Generator
+  {static_cast<G4int>(LogLevel::Info)},     // Optical
+  {static_cast<G4int>(LogLevel::Info)},     // Detector
+};
+
+namespace
+{
+const std::size_t flushThreshold = 64 * 1024;
+
+G4ThreadLocal std::ostringstream* line = nullptr;
+G4ThreadLocal std::string* buffer = nullptr;
+
+LogLevel ParseLevel(const G4String& name)
+{
+  if (name == "error") return LogLevel::Error;
+  if (name == "warning") return LogLevel::Warning;
+  if (name == "info") return LogLevel::Info;
+  if (name == "debug") return LogLevel::Debug;
+  return LogLevel::Trace;
+}
+
+// Target object for the /crd/log/ commands
+class LogCommands
+{
+  public:
+    LogCommands()
+    {
+      fMessenger = new G4GenericMessenger(this, "/crd/log/", "Logging verbosity");
+      Declare("sd", &LogCommands::SetSD, "sensitive detector");
+      Declare("event", &LogCommands::SetEvent, "event action");
+      Declare("run", &LogCommands::SetRun, "run action");
+      Declare("generator", &LogCommands::SetGenerator, "primary generator");
+      Declare("optical", &LogCommands::SetOptical, "optical LUT");
+      Declare("detector", &LogCommands::SetDetector, "detector construction");
+      Declare("all", &LogCommands::SetAll, "all components");
+    }
+
+    void SetSD(const G4String& level) { Log::SetLevel(LogCategory::SD, ParseLevel(level)); }
+    void SetEvent(const G4String& level) { Log::SetLevel(LogCategory::Event, ParseLevel(level)); }
+    void SetRun(const G4String& level) { Log::SetLevel(LogCategory::Run, ParseLevel(level)); }
+    void SetGenerator(const G4String& level)
+    {
+      Log::SetLevel(LogCategory::Generator, ParseLevel(level));
+    }
+    void SetOptical(const G4String& level)
+    {
+      Log::SetLevel(LogCategory::Optical, ParseLevel(level));
+    }
+    void SetDetector(const G4String& level)
+    {
+      Log::SetLevel(LogCategory::Detector, ParseLevel(level));
+    }
+    void SetAll(const G4String& level) { Log::SetAllLevels(ParseLevel(level)); }
+
+  private:
+    void Declare(const G4String& name, void (LogCommands::*method)(const G4String&),
+                 const G4String& what)
+    {
+      // Levels are process-wide, so there is nothing to broadcast to workers
+      auto& cmd = fMessenger->DeclareMethod(name, method, "Log level for the " + what + ".");
+      cmd.SetParameterName("level", false);
+      cmd.SetCandidates("error warning info debug trace");
+      cmd.SetToBeBroadcasted(false);
+    }
+
+    G4GenericMessenger* fMessenger = nullptr;
+};
+}  // namespace
+
+void Log::SetLevel(LogCategory category, LogLevel level)
+{
+  fLevels[static_cast<G4int>(category)].store(static_cast<G4int>(level),
+                                              std::memory_order_relaxed);
+}
+
+void Log::SetAllLevels(LogLevel level)
+{
+  for (G4int i = 0; i < static_cast<G4int>(LogCategory::Count); i++) {
+    SetLevel(static_cast<LogCategory>(i), level);
+  }
+}
+
+std::ostringstream& Log::Line()
+{
+  if (!line) line = new std::ostringstream;
+  line->str("");
+  return *line;
+}
+
+void Log::Commit()
+{
+  if (!buffer) {
+    buffer = new std::string;
+    buffer->reserve(flushThreshold + 1024);
+  }
+  buffer->append(line->str());
+  buffer->push_back('\n');
+  if (buffer->size() >= flushThreshold) Flush();
+}
+
+void Log::Flush()
+{
+  if (!buffer || buffer->empty()) return;
+  buffer->pop_back();  // G4endl supplies the last newline
+  G4cout << *buffer << G4endl;
+  buffer->clear();
+}
+
+void Log::DefineCommands()
+{
+  static LogCommands* commands = nullptr;
+  if (!commands) commands = new LogCommands();
+}
+
+}  // namespace B1
@@ -0,0 +1,339 @@
+// Optical photon governor: time gate, escape kill and reflection roulette
+// Yale Cubesat
+
+#include "OpticalGovernor.hh"
+
+#include "Log.hh"
+#include "ScintillatorProperties.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4OpBoundaryProcess.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4ProcessManager.hh"
+#include "G4Step.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Track.hh"
+#include "G4VProcess.hh"
+#include "G4VPhysicalVolume.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+
+namespace B1
+{
+
+namespace
+{
+constexpr G4int kRules = static_cast<G4int>(GovernorRule::Count);
+}
+
+void GovernorStats::Merge(const G4VAccumulable& other)
+{
+  const auto& rhs = static_cast<const GovernorStats&>(other);
+  events += rhs.events;
+  photons += rhs.photons;
+  steps += rhs.steps;
+  saved += rhs.saved;
+  for (G4int i = 0; i < kRules; i++) killed[i] += rhs.killed[i];
+}
+
+void GovernorStats::Reset()
+{
+  events = photons = steps = saved = 0.;
+  std::fill(killed, killed + kRules, 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OpticalGovernor* OpticalGovernor::Instance()
+{
+  static G4ThreadLocal OpticalGovernor* instance = nullptr;
+  if (!instance) instance = new OpticalGovernor();
+  return instance;
+}
+
+OpticalGovernor::OpticalGovernor()
+{
+  DefineCommands();
+}
+
+void OpticalGovernor::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/optical/governor/",
+                                      "Early termination of optical photons");
+
+  auto& gateCmd = fMessenger->DeclarePropertyWithUnit("gate", "ns", fGate,
+                                                      "Kill optical photons later than this "
+                                                      "(0: no time gate).");
+  gateCmd.SetParameterName("time", false);
+  gateCmd.SetRange("time>=0.");
+  gateCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& escapeCmd = fMessenger->DeclareProperty("escape", fKillEscaped,
+                                                "Kill optical photons outside the "
+                                                "scintillator and the SiPM.");
+  escapeCmd.SetParameterName("kill", false);
+  escapeCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& rouletteCmd = fMessenger->DeclareProperty("rouletteAfter", fRouletteAfter,
+                                                  "Russian roulette after every N "
+                                                  "reflections (0: off).");
+  rouletteCmd.SetParameterName("N", false);
+  rouletteCmd.SetRange("N>=0");
+  rouletteCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& survivalCmd = fMessenger->DeclareProperty("survival", fSurvival,
+                                                  "Survival probability of the roulette.");
+  survivalCmd.SetParameterName("p", false);
+  survivalCmd.SetRange("p>0. && p<=1.");
+  survivalCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& yieldCmd = fMessenger->DeclareProperty("yieldFactor", fYieldFactor,
+                                               "Scintillate at yield/k and count every "
+                                               "detected scintillation photon k times.");
+  yieldCmd.SetParameterName("k", false);
+  yieldCmd.SetRange("k>=1.");
+  yieldCmd.SetStates(G4State_PreInit, G4State_Idle);
+}
+
+G4bool OpticalGovernor::IsScintillation(const G4Track* track)
+{
+  // Optical primaries only come from DepositReplay, which scintillates
+  if (track->GetParentID() == 0) return true;
+  const auto* creator = track->GetCreatorProcess();
+  return creator && creator->GetProcessName() == "Scintillation";
+}
+
+void OpticalGovernor::LookUp()
+{
+  if (fLookedUp) return;
+  auto* store = G4LogicalVolumeStore::GetInstance();
+  fScintillator = store->GetVolume("Scintillator", false);
+  fDetector = store->GetVolume("PhotonDetector", false);
+  auto* processes = G4OpticalPhoton::Definition()->GetProcessManager()->GetProcessList();
+  for (size_t i = 0; i < processes->size(); i++) {
+    if ((*processes)[i]->GetProcessName() != "OpBoundary") continue;
+    fBoundary = dynamic_cast<const G4OpBoundaryProcess*>((*processes)[i]);
+  }
+  ScintillatorProperties scintillator;
+  if (fScintillator && scintillator.Read(fScintillator->GetMaterial()))
+    fDecayTime = scintillator.decayTime;
+  fLookedUp = true;
+}
+
+G4bool OpticalGovernor::AcceptNew(const G4Track* track)
+{
+  GovernorRule rule = GovernorRule::Count;
+  if (fGate > 0. && track->GetGlobalTime() > fGate) {
+    rule = GovernorRule::Gate;
+    fNewOrigins.erase(track);  // its address may be reused
+  }
+  else if (fYieldFactor > 1. && IsScintillation(track)) {
+    // Survivors of a step were picked by Scintillate, replayed ones here
+    PhotonOrigin origin;
+    G4bool survived = false;
+    if (track->GetParentID() > 0) {
+      auto it = fNewOrigins.find(track);
+      if (it != fNewOrigins.end()) {
+        origin = it->second;
+        survived = true;
+        fNewOrigins.erase(it);
+      }
+    }
+    else {
+      LookUp();
+      const auto index = static_cast<std::size_t>(track->GetTrackID() - 1);
+      survived = G4UniformRand() * fYieldFactor < 1.;
+      origin.start = index < fReplayed.size() ? fReplayed[index] : track->GetGlobalTime();
+    }
+    if (survived) {
+      origin.emitted = track->GetGlobalTime();
+      fOrigins[track->GetTrackID()] = origin;
+    }
+    else {
+      rule = GovernorRule::Yield;
+    }
+  }
+  if (rule == GovernorRule::Count) return true;
+
+  fEvent.photons++;
+  fEvent.killed[static_cast<G4int>(rule)]++;
+  return false;
+}
+
+G4bool OpticalGovernor::IsReflection(const G4Step* step)
+{
+  // OpBoundary is a forced process, so Transportation limits the step; the
+  // status it leaves is that of this step
+  if (!fBoundary) return false;
+  if (step->GetPostStepPoint()->GetStepStatus() != fGeomBoundary) return false;
+  switch (fBoundary->GetStatus()) {
+    case FresnelReflection:
+    case TotalInternalReflection:
+    case LambertianReflection:
+    case LobeReflection:
+    case SpikeReflection:
+    case BackScattering:
+      return true;
+    default:
+      return false;
+  }
+}
+
+G4bool OpticalGovernor::IsEscape(const G4Step* step)
+{
+  // On a boundary the post-step point is across it even when the photon is
+  // reflected back, so only a crossing counts
+  const auto* post = step->GetPostStepPoint();
+  if (post->GetStepStatus() != fGeomBoundary || !post->GetPhysicalVolume()) return false;
+  const auto* volume = post->GetPhysicalVolume()->GetLogicalVolume();
+  if (volume == fScintillator || volume == fDetector) return false;
+  if (!fBoundary) return true;
+  const auto status = fBoundary->GetStatus();
+  return status == FresnelRefraction || status == Transmission;
+}
+
+void OpticalGovernor::Step(const G4Step* step)
+{
+  LookUp();
+
+  auto* track = step->GetTrack();
+  const G4int stepNumber = track->GetCurrentStepNumber();
+  if (stepNumber == 1) {
+    fTrackID = track->GetTrackID();
+    fReflections = 0;
+    fWeight = 1.;
+    fEvent.photons++;
+  }
+  fEvent.steps++;
+
+  // Absorbed, detected or out of the world: the reference for steps saved
+  if (track->GetTrackStatus() != fAlive) {
+    if (fYieldFactor > 1.) fOrigins.erase(track->GetTrackID());
+    fEvent.ended++;
+    fEvent.endedSteps += stepNumber;
+    return;
+  }
+
+  const auto* post = step->GetPostStepPoint();
+  GovernorRule rule = GovernorRule::Count;
+  if (fGate > 0. && post->GetGlobalTime() > fGate) {
+    rule = GovernorRule::Gate;
+  }
+  else if (fKillEscaped && IsEscape(step)) {
+    rule = GovernorRule::Escape;
+  }
+  if (rule == GovernorRule::Count && fRouletteAfter > 0 && IsReflection(step)
+      && ++fReflections % fRouletteAfter == 0)
+  {
+    if (G4UniformRand() < fSurvival)
+      fWeight /= fSurvival;
+    else
+      rule = GovernorRule::Roulette;
+  }
+  if (rule == GovernorRule::Count) return;
+
+  track->SetTrackStatus(fStopAndKill);
+  if (fYieldFactor > 1.) fOrigins.erase(track->GetTrackID());
+  fEvent.killed[static_cast<G4int>(rule)]++;
+  fEvent.killedSteps += stepNumber;
+}
+
+void OpticalGovernor::Scintillate(const G4Step* step)
+{
+  const auto* secondaries = step->GetSecondaryInCurrentStep();
+  if (!secondaries || secondaries->empty()) return;
+  LookUp();
+
+  // Every photon of the step was emitted somewhere along it, so the copies
+  // of a survivor are drawn from the same interval
+  const G4double start = step->GetPreStepPoint()->GetGlobalTime();
+  const G4double duration = step->GetPostStepPoint()->GetGlobalTime() - start;
+  for (const auto* secondary : *secondaries) {
+    if (secondary->GetDefinition() != G4OpticalPhoton::Definition()) continue;
+    if (!IsScintillation(secondary)) continue;
+    if (G4UniformRand() * fYieldFactor >= 1.) continue;  // killed at stacking
+    fNewOrigins[secondary] = {start, duration, 0.};
+  }
+}
+
+void OpticalGovernor::AddReplayed(G4double time)
+{
+  if (fYieldFactor > 1.) fReplayed.push_back(time);
+}
+
+G4double OpticalGovernor::GetPhotonWeight(const G4Track* track) const
+{
+  // Before its first step is over the track has not been rouletted
+  G4double weight = track->GetTrackID() == fTrackID ? fWeight : 1.;
+  if (fYieldFactor > 1. && IsScintillation(track)) weight *= fYieldFactor;
+  return weight;
+}
+
+const PhotonOrigin* OpticalGovernor::GetOrigin(const G4Track* track) const
+{
+  if (fYieldFactor <= 1.) return nullptr;
+  auto it = fOrigins.find(track->GetTrackID());
+  return it != fOrigins.end() ? &it->second : nullptr;
+}
+
+G4double OpticalGovernor::CopyTime(const PhotonOrigin& origin, G4double time) const
+{
+  G4double emitted = origin.start + G4UniformRand() * origin.duration;
+  if (fDecayTime > 0.) emitted += G4RandExponential::shoot(fDecayTime);
+  return emitted + (time - origin.emitted);
+}
+
+void OpticalGovernor::BeginOfEvent()
+{
+  fEvent = Counts();
+  fTrackID = -1;
+  fWeight = 1.;
+  // The replayed deposit times came with the primaries, before this
+  fNewOrigins.clear();
+  fOrigins.clear();
+}
+
+void OpticalGovernor::EndOfEvent(G4int eventID)
+{
+  fReplayed.clear();
+  if (!IsActive()) return;
+
+  G4long killed = 0;
+  for (auto n : fEvent.killed) killed += n;
+  const G4double meanSteps =
+    fEvent.ended > 0 ? static_cast<G4double>(fEvent.endedSteps) / fEvent.ended : 0.;
+  const G4double saved = std::max(0., killed * meanSteps - fEvent.killedSteps);
+
+  CRD_DEBUG(Optical, "[OpticalGovernor] event " << eventID << ": " << fEvent.photons
+         << " photons, " << fEvent.steps << " steps, killed " << killed << " (gate "
+         << fEvent.killed[static_cast<G4int>(GovernorRule::Gate)] << ", escape "
+         << fEvent.killed[static_cast<G4int>(GovernorRule::Escape)] << ", roulette "
+         << fEvent.killed[static_cast<G4int>(GovernorRule::Roulette)] << ", yield "
+         << fEvent.killed[static_cast<G4int>(GovernorRule::Yield)] << "), ~"
+         << static_cast<G4long>(saved) << " steps saved");
+
+  fStats.events += 1.;
+  fStats.photons += fEvent.photons;
+  fStats.steps += fEvent.steps;
+  fStats.saved += saved;
+  for (G4int i = 0; i < kRules; i++) fStats.killed[i] += fEvent.killed[i];
+}
+
+void OpticalGovernor::EndOfRun() const
+{
+  if (!IsActive() || fStats.events <= 0.) return;
+
+  const G4double events = fStats.events;
+  CRD_INFO(Optical, "[OpticalGovernor] per event: " << fStats.photons / events
+         << " photons, " << fStats.steps / events << " steps tracked, killed by gate "
+         << fStats.killed[static_cast<G4int>(GovernorRule::Gate)] / events << ", escape "
+         << fStats.killed[static_cast<G4int>(GovernorRule::Escape)] / events << ", roulette "
+         << fStats.killed[static_cast<G4int>(GovernorRule::Roulette)] / events << ", yield "
+         << fStats.killed[static_cast<G4int>(GovernorRule::Yield)] / events << ", ~"
+         << fStats.saved / events << " steps saved");
+}
+
+}  // namespace B1
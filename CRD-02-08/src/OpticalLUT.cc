@@ -0,0 +1,439 @@
+// Optical light-collection lookup table
+// Yale Cubesat
+
+#include "OpticalLUT.hh"
+
+#include "Log.hh"
+#include "ScintillatorProperties.hh"
+#include "SiPMSD.hh"
+
+#include "G4AutoLock.hh"
+#include "G4Box.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalSkinSurface.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4Material.hh"
+#include "G4MaterialPropertiesTable.hh"
+#include "G4OpticalSurface.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4Poisson.hh"
+#include "G4ProcessTable.hh"
+#include "G4SDManager.hh"
+#include "G4Step.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Track.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4VProcess.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+namespace B1
+{
+
+namespace
+{
+const char lutMagic[8] = {'C', 'R', 'D', 'L', 'U', 'T', '0', '1'};
+
+G4Mutex lutCacheMutex = G4MUTEX_INITIALIZER;
+std::map<G4String, std::shared_ptr<const LightCollectionMap>> lutCache;
+
+// FNV-1a over the raw bytes of each value
+struct GeometryHash
+{
+  std::uint64_t value = 1469598103934665603ull;
+  void Add(G4double x)
+  {
+    unsigned char bytes[sizeof(x)];
+    std::memcpy(bytes, &x, sizeof(x));
+    for (auto b : bytes) {
+      value ^= b;
+      value *= 1099511628211ull;
+    }
+  }
+};
+}  // namespace
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void LightCollectionMap::Configure(const G4ThreeVector& halfSize, G4double voxelSize,
+                                   G4int nTimeBins, G4double timeWindow,
+                                   std::uint64_t geometryHash)
+{
+  fHalfSize = halfSize;
+  for (G4int i = 0; i < 3; i++) {
+    fN[i] = std::max(1, static_cast<G4int>(std::ceil(2. * halfSize[i] / voxelSize)));
+  }
+  fNTime = nTimeBins;
+  fTimeWindow = timeWindow;
+  fHash = geometryHash;
+  Reset();
+}
+
+void LightCollectionMap::Merge(const G4VAccumulable& other)
+{
+  const auto& rhs = static_cast<const LightCollectionMap&>(other);
+  if (rhs.fEmitted.size() != fEmitted.size() || rhs.fTimeHist.size() != fTimeHist.size()) return;
+  for (size_t i = 0; i < fEmitted.size(); i++) {
+    fEmitted[i] += rhs.fEmitted[i];
+    fDetected[i] += rhs.fDetected[i];
+    fEnergySum[i] += rhs.fEnergySum[i];
+  }
+  for (size_t i = 0; i < fTimeHist.size(); i++) fTimeHist[i] += rhs.fTimeHist[i];
+}
+
+void LightCollectionMap::Reset()
+{
+  const size_t nVoxels = static_cast<size_t>(fN[0]) * fN[1] * fN[2];
+  fEmitted.assign(nVoxels, 0.);
+  fDetected.assign(nVoxels, 0.);
+  fEnergySum.assign(nVoxels, 0.);
+  fTimeHist.assign(nVoxels * fNTime, 0.);
+  fTimeCdf.clear();
+}
+
+G4int LightCollectionMap::VoxelIndex(const G4ThreeVector& position) const
+{
+  G4int idx[3];
+  for (G4int i = 0; i < 3; i++) {
+    if (fN[i] == 0) return -1;
+    G4double u = (position[i] + fHalfSize[i]) / (2. * fHalfSize[i]);
+    if (u < 0. || u > 1.) return -1;
+    idx[i] = std::min(static_cast<G4int>(u * fN[i]), fN[i] - 1);
+  }
+  return (idx[2] * fN[1] + idx[1]) * fN[0] + idx[0];
+}
+
+void LightCollectionMap::AddEmission(const G4ThreeVector& position)
+{
+  G4int voxel = VoxelIndex(position);
+  if (voxel >= 0) fEmitted[voxel] += 1.;
+}
+
+void LightCollectionMap::AddDetection(const G4ThreeVector& emission, G4double transitTime,
+                                      G4double energy)
+{
+  G4int voxel = VoxelIndex(emission);
+  if (voxel < 0) return;
+  fDetected[voxel] += 1.;
+  fEnergySum[voxel] += energy;
+  // late photons go to the last bin rather than being lost from the normalisation
+  G4int bin = std::clamp(static_cast<G4int>(transitTime / fTimeWindow * fNTime), 0, fNTime - 1);
+  fTimeHist[static_cast<size_t>(voxel) * fNTime + bin] += 1.;
+}
+
+G4double LightCollectionMap::GetTotalEmitted() const
+{
+  G4double total = 0.;
+  for (auto n : fEmitted) total += n;
+  return total;
+}
+
+G4bool LightCollectionMap::Save(const G4String& fileName) const
+{
+  std::ofstream out(fileName, std::ios::binary);
+  if (!out.is_open()) return false;
+
+  auto writeVector = [&out](const std::vector<G4double>& v) {
+    out.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(G4double));
+  };
+  std::int32_t dims[4] = {fN[0], fN[1], fN[2], fNTime};
+  G4double extent[4] = {fHalfSize.x(), fHalfSize.y(), fHalfSize.z(), fTimeWindow};
+  out.write(lutMagic, sizeof(lutMagic));
+  out.write(reinterpret_cast<const char*>(&fHash), sizeof(fHash));
+  out.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+  out.write(reinterpret_cast<const char*>(extent), sizeof(extent));
+  writeVector(fEmitted);
+  writeVector(fDetected);
+  writeVector(fEnergySum);
+  writeVector(fTimeHist);
+  return out.good();
+}
+
+G4bool LightCollectionMap::Load(const G4String& fileName)
+{
+  std::ifstream in(fileName, std::ios::binary);
+  if (!in.is_open()) return false;
+
+  char magic[sizeof(lutMagic)];
+  std::int32_t dims[4];
+  G4double extent[4];
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&fHash), sizeof(fHash));
+  in.read(reinterpret_cast<char*>(dims), sizeof(dims));
+  in.read(reinterpret_cast<char*>(extent), sizeof(extent));
+  if (!in.good() || std::memcmp(magic, lutMagic, sizeof(magic)) != 0) return false;
+
+  for (G4int i = 0; i < 3; i++) fN[i] = dims[i];
+  fNTime = dims[3];
+  fHalfSize = G4ThreeVector(extent[0], extent[1], extent[2]);
+  fTimeWindow = extent[3];
+  Reset();
+
+  auto readVector = [&in](std::vector<G4double>& v) {
+    in.read(reinterpret_cast<char*>(v.data()), v.size() * sizeof(G4double));
+  };
+  readVector(fEmitted);
+  readVector(fDetected);
+  readVector(fEnergySum);
+  readVector(fTimeHist);
+  return in.good();
+}
+
+void LightCollectionMap::PrepareSampling()
+{
+  fTimeCdf.assign(fTimeHist.size(), 1.f);
+  for (size_t voxel = 0; voxel < fEmitted.size(); voxel++) {
+    const size_t first = voxel * fNTime;
+    G4double total = 0.;
+    for (G4int b = 0; b < fNTime; b++) total += fTimeHist[first + b];
+    if (total <= 0.) continue;
+    G4double running = 0.;
+    for (G4int b = 0; b < fNTime; b++) {
+      running += fTimeHist[first + b];
+      fTimeCdf[first + b] = static_cast<G4float>(running / total);
+    }
+  }
+}
+
+G4double LightCollectionMap::GetCollectionProbability(G4int voxel) const
+{
+  return fEmitted[voxel] > 0. ? fDetected[voxel] / fEmitted[voxel] : 0.;
+}
+
+G4double LightCollectionMap::GetMeanPhotonEnergy(G4int voxel) const
+{
+  return fDetected[voxel] > 0. ? fEnergySum[voxel] / fDetected[voxel] : 0.;
+}
+
+G4double LightCollectionMap::SampleTransitTime(G4int voxel) const
+{
+  auto first = fTimeCdf.begin() + static_cast<size_t>(voxel) * fNTime;
+  auto it = std::lower_bound(first, first + fNTime, static_cast<G4float>(G4UniformRand()));
+  G4int bin = std::min<G4int>(it - first, fNTime - 1);
+  return (bin + G4UniformRand()) * fTimeWindow / fNTime;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OpticalLUT* OpticalLUT::Instance()
+{
+  static G4ThreadLocal OpticalLUT* instance = nullptr;
+  if (!instance) instance = new OpticalLUT();
+  return instance;
+}
+
+OpticalLUT::OpticalLUT() : fVoxelSize(1. * mm), fTimeWindow(50. * ns)
+{
+  DefineCommands();
+}
+
+void OpticalLUT::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/optical/", "Optical photon treatment");
+
+  auto& modeCmd = fMessenger->DeclareMethod("mode", &OpticalLUT::SetMode,
+                                            "full: track every optical photon. "
+                                            "calibrate: full tracking, and fill the light-"
+                                            "collection map written at the end of the run. "
+                                            "lut: no optical photons, SiPM hits sampled from "
+                                            "the map of the current geometry.");
+  modeCmd.SetParameterName("mode", false);
+  modeCmd.SetCandidates("full calibrate lut");
+  modeCmd.SetStates(G4State_Idle);
+
+  auto& voxelCmd = fMessenger->DeclarePropertyWithUnit("voxelSize", "mm", fVoxelSize,
+                                                       "Voxel size of the light-collection map.");
+  voxelCmd.SetParameterName("size", false);
+  voxelCmd.SetRange("size>0.");
+}
+
+void OpticalLUT::SetMode(const G4String& mode)
+{
+  fMode = Mode::Full;
+  if (mode == "calibrate") fMode = Mode::Calibrate;
+
+  if (mode == "lut" && LocateGeometry()) {
+    const G4String fileName = TableFileName();
+    G4AutoLock lock(&lutCacheMutex);
+    auto cached = lutCache.find(fileName);
+    if (cached == lutCache.end()) {
+      auto table = std::make_shared<LightCollectionMap>();
+      if (table->Load(fileName) && table->GetGeometryHash() == fGeometryHash) {
+        table->PrepareSampling();
+        CRD_INFO(Optical, "[OpticalLUT] Loaded light-collection map " << fileName);
+        cached = lutCache.emplace(fileName, table).first;
+      }
+    }
+    if (cached != lutCache.end()) {
+      fTable = cached->second;
+      fMode = Mode::Lookup;
+    }
+    else {
+      G4ExceptionDescription msg;
+      msg << "No light-collection map " << fileName << " for this geometry.\n"
+          << "Run with /crd/optical/mode calibrate first. Keeping full optical tracking.";
+      G4Exception("OpticalLUT::SetMode()", "OpticalLUT001", JustWarning, msg);
+    }
+  }
+
+  // In LUT mode the light comes from the map, so no optical photons are made
+  const G4bool optical = (fMode != Mode::Lookup);
+  auto* processTable = G4ProcessTable::GetProcessTable();
+  processTable->SetProcessActivation("Scintillation", optical);
+  processTable->SetProcessActivation("Cerenkov", optical);
+}
+
+G4bool OpticalLUT::LocateGeometry()
+{
+  auto* scintLV = G4LogicalVolumeStore::GetInstance()->GetVolume("Scintillator", false);
+  auto* sipmPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("PhotonDetector", false);
+  auto* scintBox = scintLV ? dynamic_cast<G4Box*>(scintLV->GetSolid()) : nullptr;
+  auto* sipmBox = sipmPV ? dynamic_cast<G4Box*>(sipmPV->GetLogicalVolume()->GetSolid()) : nullptr;
+  if (!scintBox || !sipmBox) {
+    G4Exception("OpticalLUT::LocateGeometry()", "OpticalLUT002", JustWarning,
+                "Scintillator or PhotonDetector box not found.");
+    return false;
+  }
+
+  fScintHalfSize = G4ThreeVector(scintBox->GetXHalfLength(), scintBox->GetYHalfLength(),
+                                 scintBox->GetZHalfLength());
+  fSiPMPosition = sipmPV->GetTranslation();
+
+  GeometryHash hash;
+  for (G4int i = 0; i < 3; i++) {
+    hash.Add(fScintHalfSize[i]);
+    hash.Add(fSiPMPosition[i]);
+  }
+  hash.Add(sipmBox->GetXHalfLength());
+  hash.Add(sipmBox->GetYHalfLength());
+  hash.Add(sipmBox->GetZHalfLength());
+  hash.Add(fVoxelSize);
+  hash.Add(fTimeWindow);
+  hash.Add(fTimeBins);
+
+  // Optical properties at the peak of the emission spectrum
+  const G4double probeEnergy = ScintillatorProperties::kPeakEnergy;
+  auto* mpt = scintLV->GetMaterial()->GetMaterialPropertiesTable();
+  if (mpt) {
+    for (auto key : {"RINDEX", "ABSLENGTH"}) {
+      auto* property = mpt->GetProperty(key);
+      if (property) hash.Add(property->Value(probeEnergy));
+    }
+  }
+  ScintillatorProperties scintillator;
+  scintillator.Read(scintLV->GetMaterial());
+  fYield = scintillator.yield;
+  fDecayTime = scintillator.decayTime;
+  auto* sipmMpt = sipmPV->GetLogicalVolume()->GetMaterial()->GetMaterialPropertiesTable();
+  auto* pde = sipmMpt ? sipmMpt->GetProperty("PDE") : nullptr;
+  if (pde) hash.Add(pde->Value(probeEnergy));
+
+  auto* skin = G4LogicalSkinSurface::GetSurface(scintLV);
+  auto* paint = skin ? dynamic_cast<G4OpticalSurface*>(skin->GetSurfaceProperty()) : nullptr;
+  if (paint) {
+    hash.Add(paint->GetFinish());
+    hash.Add(paint->GetModel());
+    auto* paintMpt = paint->GetMaterialPropertiesTable();
+    auto* reflectivity = paintMpt ? paintMpt->GetProperty("REFLECTIVITY") : nullptr;
+    if (reflectivity) hash.Add(reflectivity->Value(probeEnergy));
+  }
+
+  fGeometryHash = hash.value;
+  return true;
+}
+
+G4String OpticalLUT::TableFileName() const
+{
+  std::ostringstream name;
+  name << "optical_lut_" << std::hex << std::setw(16) << std::setfill('0') << fGeometryHash
+       << ".bin";
+  return name.str();
+}
+
+void OpticalLUT::BeginOfRun()
+{
+  // LUT photons are handed to this thread's SiPM detector (none on the master)
+  fSiPMSD = static_cast<SiPMSD*>(
+    G4SDManager::GetSDMpointer()->FindSensitiveDetector("SiPM_SD", false));
+
+  if (fMode != Mode::Calibrate) return;
+  if (!LocateGeometry()) {
+    fMode = Mode::Full;
+    return;
+  }
+  fCalibration.Configure(fScintHalfSize, fVoxelSize, fTimeBins, fTimeWindow, fGeometryHash);
+}
+
+void OpticalLUT::EndOfRun()
+{
+  if (fMode != Mode::Calibrate) return;
+
+  const G4String fileName = TableFileName();
+  if (fCalibration.Save(fileName)) {
+    CRD_INFO(Optical, "[OpticalLUT] Light-collection map from " << fCalibration.GetTotalEmitted()
+           << " photons written to " << fileName);
+  }
+  else {
+    G4ExceptionDescription msg;
+    msg << "Could not write light-collection map " << fileName;
+    G4Exception("OpticalLUT::EndOfRun()", "OpticalLUT003", JustWarning, msg);
+  }
+}
+
+void OpticalLUT::RecordEmission(const G4Track* track)
+{
+  const auto* creator = track->GetCreatorProcess();
+  if (!creator || creator->GetProcessName() != "Scintillation") return;
+  fCalibration.AddEmission(track->GetVertexPosition());
+}
+
+void OpticalLUT::RecordDetection(const G4Track* track)
+{
+  const auto* creator = track->GetCreatorProcess();
+  if (!creator || creator->GetProcessName() != "Scintillation") return;
+  fCalibration.AddDetection(track->GetVertexPosition(), track->GetLocalTime(),
+                            track->GetKineticEnergy());
+}
+
+void OpticalLUT::GenerateHits(const G4Step* step) const
+{
+  const G4double edep = step->GetTotalEnergyDeposit();
+  if (!fTable || !fSiPMSD || edep <= 0.) return;
+
+  const auto* pre = step->GetPreStepPoint();
+  const auto* post = step->GetPostStepPoint();
+  const G4ThreeVector start = pre->GetPosition();
+  const G4ThreeVector delta = post->GetPosition() - start;
+  const G4double t0 = pre->GetGlobalTime();
+  const G4double dt = post->GetGlobalTime() - t0;
+
+  // Mean detected count from the collection probability at the step midpoint
+  G4int voxel = fTable->VoxelIndex(start + 0.5 * delta);
+  if (voxel < 0) return;
+  const G4double mean = fYield * edep * fTable->GetCollectionProbability(voxel);
+  const G4long nDetected = G4Poisson(mean);
+
+  for (G4long i = 0; i < nDetected; i++) {
+    G4double u = G4UniformRand();
+    G4int emitVoxel = fTable->VoxelIndex(start + u * delta);
+    if (emitVoxel < 0) emitVoxel = voxel;
+    G4double time = t0 + u * dt + fTable->SampleTransitTime(emitVoxel);
+    if (fDecayTime > 0.) time += G4RandExponential::shoot(fDecayTime);
+
+    // Photons are not tracked, so the hit is placed at the SiPM centre and
+    // carries the ID of the charged track that made the light
+    fSiPMSD->RecordPhoton(fSiPMPosition, time, fTable->GetMeanPhotonEnergy(emitVoxel), 0,
+                          step->GetTrack()->GetTrackID());
+  }
+}
+
+}  // namespace B1
@@ -0,0 +1,201 @@
+// Dedicated output thread fed by the event actions
+// Yale Cubesat
+
+#include "OutputThread.hh"
+
+#include "DepositReplay.hh"
+#include "G4GenericMessenger.hh"
+#include "Log.hh"
+#include "SiPMReadout.hh"
+
+#include <algorithm>
+#include <chrono>
+
+namespace B1
+{
+
+OutputThread* OutputThread::Instance()
+{
+  static OutputThread* instance = new OutputThread();
+  return instance;
+}
+
+OutputThread::OutputThread()
+{
+  DefineCommands();
+}
+
+void OutputThread::DefineCommands()
+{
+  // The settings are read by the master when the run starts, so nothing
+  // is broadcast to the workers
+  fMessenger = new G4GenericMessenger(this, "/crd/output/", "Hit output");
+
+  auto& chunkCmd = fMessenger->DeclareProperty("chunkSize", fChunkSize,
+                                               "Hits of each type and thread buffered "
+                                               "before they are written as a row group.");
+  chunkCmd.SetParameterName("hits", false);
+  chunkCmd.SetRange("hits>0");
+  chunkCmd.SetStates(G4State_PreInit, G4State_Idle);
+  chunkCmd.SetToBeBroadcasted(false);
+
+  auto& queueCmd = fMessenger->DeclareProperty("queueSize", fQueueSize,
+                                               "Event records that can wait for the "
+                                               "output thread before workers stall.");
+  queueCmd.SetParameterName("records", false);
+  queueCmd.SetRange("records>0");
+  queueCmd.SetStates(G4State_PreInit, G4State_Idle);
+  queueCmd.SetToBeBroadcasted(false);
+
+  auto& hitsCmd = fMessenger->DeclareProperty("hits", fRecordHits,
+                                              "Write every SiPM photon hit, not just the "
+                                              "per-event summary.");
+  hitsCmd.SetParameterName("record", false);
+  hitsCmd.SetStates(G4State_PreInit, G4State_Idle);
+  hitsCmd.SetToBeBroadcasted(false);
+
+  auto& stepCmd = fMessenger->DeclareProperty("stepHits", fRecordStepHits,
+                                              "Also write every energy-deposit step "
+                                              "(large output).");
+  stepCmd.SetParameterName("record", false);
+  stepCmd.SetStates(G4State_PreInit, G4State_Idle);
+  stepCmd.SetToBeBroadcasted(false);
+}
+
+void OutputThread::Start()
+{
+  if (fThread.joinable()) Stop();  // previous run aborted
+
+  fQueue = std::make_unique<BoundedQueue<std::unique_ptr<EventRecord>>>(fQueueSize);
+  if (!fFreeRecords || fFreeRecords->Capacity() < fQueue->Capacity()) {
+    fFreeRecords = std::make_unique<BoundedQueue<std::unique_ptr<EventRecord>>>(fQueueSize);
+  }
+  fStalls = 0;
+  fStallNanoseconds = 0;
+  fMaxDepth = 0;
+
+  fSummaries.Open(fChunkSize);
+  if (fRecordHits || fRecordStepHits) fHits.Open(fChunkSize);
+  auto* readout = SiPMReadout::Instance();
+  fWriteHistograms = readout->GetMode() == SiPMReadout::Mode::Histogram;
+  if (fWriteHistograms)
+    fHistograms.Open(fChunkSize, readout->GetBinWidth(), readout->GetNumberOfBins());
+  fWriteWaveforms = readout->GetWaveform().enable;
+  if (fWriteWaveforms) fWaveforms.Open(readout->GetWaveform());
+  // DepositReplay is per thread, but the commands reach the master's too
+  fWriteDeposits = DepositReplay::Instance()->GetMode() == DepositReplay::Mode::Record;
+  if (fWriteDeposits) fDeposits.Open(fChunkSize);
+  fStopping = false;
+  fThread = std::thread(&OutputThread::Loop, this);
+}
+
+std::unique_ptr<EventRecord> OutputThread::AcquireRecord()
+{
+  std::unique_ptr<EventRecord> record;
+  if (fFreeRecords->TryPop(record)) return record;
+  return std::make_unique<EventRecord>();
+}
+
+void OutputThread::Submit(std::unique_ptr<EventRecord> record)
+{
+  if (fQueue->TryPush(std::move(record))) return;
+
+  // Queue full: the disk is behind, wait for room rather than drop events
+  auto start = std::chrono::steady_clock::now();
+  do {
+    std::this_thread::yield();
+  } while (!fQueue->TryPush(std::move(record)));
+  auto waited = std::chrono::steady_clock::now() - start;
+
+  fStalls.fetch_add(1, std::memory_order_relaxed);
+  fStallNanoseconds.fetch_add(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+    std::memory_order_relaxed);
+}
+
+void OutputThread::Loop()
+{
+  std::unique_ptr<EventRecord> record;
+  for (;;) {
+    std::size_t depth = fQueue->Size();
+    if (fQueue->TryPop(record)) {
+      fMaxDepth = std::max(fMaxDepth, depth);
+      Write(record);
+      continue;
+    }
+    // Stop() is only called once every event has been submitted, so after
+    // seeing the flag one more pass empties the queue for good
+    if (fStopping.load(std::memory_order_acquire)) {
+      while (fQueue->TryPop(record)) Write(record);
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+void OutputThread::Write(std::unique_ptr<EventRecord>& record)
+{
+  fSummaries.Add(record->summary, record->eventID, record->thread);
+  for (G4int type = 0; type < kHitTypes; type++) {
+    auto& hits = record->hits[type];
+    if (hits.Empty()) continue;
+    fHits.Add(static_cast<HitType>(type), hits, record->eventID, record->thread);
+    hits.Clear();
+  }
+  if (record->hasTimeHistogram) {
+    if (fWriteHistograms)
+      fHistograms.Add(record->timeHistogram, record->eventID, record->thread);
+    record->timeHistogram.Clear();
+    record->hasTimeHistogram = false;
+  }
+  if (!record->pulseTrain.empty()) {
+    if (fWriteWaveforms) fWaveforms.Add(record->pulseTrain, record->eventID, record->thread);
+    record->pulseTrain.clear();
+  }
+  if (!record->deposits.Empty()) {
+    if (fWriteDeposits) {
+      const auto& summary = record->summary;
+      fDeposits.Add(record->deposits, record->eventID, record->thread, summary.weight,
+                    summary.edep, summary.primaryEnergy);
+    }
+    record->deposits.Clear();
+  }
+
+  // Back to the workers with its capacity; dropped if the pool is full
+  fFreeRecords->TryPush(std::move(record));
+  record.reset();
+}
+
+void OutputThread::Stop()
+{
+  if (!fThread.joinable()) return;
+
+  fStopping.store(true, std::memory_order_release);
+  fThread.join();
+  fSummaries.Close();
+  fHits.Close();
+  if (fWriteHistograms) fHistograms.Close();
+  if (fWriteWaveforms) fWaveforms.Close();
+  if (fWriteDeposits) fDeposits.Close();
+
+  CRD_INFO(Run, "[OutputThread] " << fSummaries.GetCount() << " event summaries written");
+  if (fRecordHits || fRecordStepHits) {
+    CRD_INFO(Run, "[OutputThread] hits written: SiPM=" << fHits.GetCount(HitType::SiPM)
+           << " MC=" << fHits.GetCount(HitType::MC) << " Step=" << fHits.GetCount(HitType::Step));
+  }
+  if (fWriteHistograms) {
+    CRD_INFO(Run, "[OutputThread] " << fHistograms.GetCount() << " SiPM time histograms written");
+  }
+  if (fWriteWaveforms) {
+    CRD_INFO(Run, "[OutputThread] " << fWaveforms.GetCount() << " waveforms written");
+  }
+  if (fWriteDeposits) {
+    CRD_INFO(Run, "[OutputThread] deposits of " << fDeposits.GetCount() << " events written");
+  }
+  CRD_INFO(Run, "[OutputThread] queue " << fMaxDepth << "/" << fQueue->Capacity()
+         << " at most, " << fStalls.load() << " worker stalls ("
+         << fStallNanoseconds.load() * 1e-6 << " ms)");
+  Log::Flush();
+}
+
+}  // namespace B1
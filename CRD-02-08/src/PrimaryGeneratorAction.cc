@@ -29,16 +29,24 @@
 
 #include "PrimaryGeneratorAction.hh"
 
+#include "DepositReplay.hh"
 #include "G4Box.hh"
+#include "G4Event.hh"
+#include "G4GenericMessenger.hh"
 #include "G4LogicalVolume.hh"
 #include "G4LogicalVolumeStore.hh"
 #include "G4ParticleGun.hh"
 #include "G4ParticleTable.hh"
+#include "G4PrimaryVertex.hh"
 #include "G4SystemOfUnits.hh"
+#include "Log.hh"
 #include "Randomize.hh"
 #include <CLHEP/Units/SystemOfUnits.h>
 #include <G4ThreeVector.hh>
 #include <G4Types.hh>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
 #include <cmath>
 
 namespace B1
@@ -58,6 +66,7 @@ G4float ProtonEnergyPDF(G4float energy)
   return result;
 }
 
+// Rejection sampler the spectrum table replaced, kept for benchmarking
 G4float RandomProtonEnergy()
 {
   G4float energy = 0;
@@ -103,6 +112,29 @@ G4ThreeVector RandomVectorNudge(G4ThreeVector v, G4float mag)
   return nudged_vector;
 }
 
+// Slab test of a ray against an origin-centred box; on a hit returns the
+// entry and exit distances along dir (entry may be negative)
+G4bool RayBoxIntersection(const G4ThreeVector& origin, const G4ThreeVector& dir,
+                          const G4Box* box, G4double& tNear, G4double& tFar)
+{
+  const G4double half[3] = {box->GetXHalfLength(), box->GetYHalfLength(), box->GetZHalfLength()};
+  tNear = -DBL_MAX;
+  tFar = DBL_MAX;
+  for (int i = 0; i < 3; i++) {
+    if (dir[i] == 0.) {
+      if (std::abs(origin[i]) > half[i]) return false;
+      continue;
+    }
+    G4double t1 = (-half[i] - origin[i]) / dir[i];
+    G4double t2 = (half[i] - origin[i]) / dir[i];
+    if (t1 > t2) std::swap(t1, t2);
+    tNear = std::max(tNear, t1);
+    tFar = std::min(tFar, t2);
+    if (tNear > tFar) return false;
+  }
+  return true;
+}
+
 PrimaryGeneratorAction::PrimaryGeneratorAction()
 {
   G4int n_particle = 1;
@@ -113,6 +145,18 @@ PrimaryGeneratorAction::PrimaryGeneratorAction()
   G4String particleName;
   G4ParticleDefinition* particle = particleTable->FindParticle(particleName = "proton");
   fParticleGun->SetParticleDefinition(particle);
+
+  // Default proton spectrum table, used until /crd/source/spectrumFile is given.
+  // The rejection loop accepted with probability ProtonEnergyPDF / max,
+  // clipped to [0, 1], so that is the density to tabulate.
+  const G4float max = 6.379347596983015 * MeV;
+  auto polySampler = std::make_shared<SpectrumSampler>();
+  polySampler->Build(
+    [max](G4double energy) { return std::min<G4double>(ProtonEnergyPDF(energy), max); },
+    0., 1000 * MeV, 8192);
+  fEnergySampler = polySampler;
+
+  DefineCommands();
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -120,6 +164,7 @@ PrimaryGeneratorAction::PrimaryGeneratorAction()
 PrimaryGeneratorAction::~PrimaryGeneratorAction()
 {
   delete fParticleGun;
+  delete fMessenger;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -129,6 +174,13 @@ void PrimaryGeneratorAction::GeneratePrimaries(G4Event* event)
   // this function is called at the begining of each event
   //
 
+  // Replay pass: the scintillation light of a recorded event instead
+  auto* replay = DepositReplay::Instance();
+  if (replay->GetMode() == DepositReplay::Mode::Replay) {
+    replay->GeneratePrimaries(event);
+    return;
+  }
+
   // In order to avoid dependence of PrimaryGeneratorAction
   // on DetectorConstruction class we get Envelope volume
   // from G4LogicalVolumeStore.
@@ -153,15 +205,167 @@ void PrimaryGeneratorAction::GeneratePrimaries(G4Event* event)
     G4Exception("PrimaryGeneratorAction::GeneratePrimaries()", "MyCode0002", JustWarning, msg);
   }
 
-  G4ThreeVector r = RandomUnitSpherePoint() * sqrt((envSizeXY * envSizeXY) + (envSizeZ * envSizeZ)) * 0.7;
-  G4ThreeVector v = RandomVectorNudge(-r, 0.3).unit();
+  G4ThreeVector r;
+  G4ThreeVector v;
+  if (fIsotropic && LocateIsotropicTarget()) {
+    GenerateIsotropicRay(r, v);
+  }
+  else {
+    r = RandomUnitSpherePoint() * sqrt((envSizeXY * envSizeXY) + (envSizeZ * envSizeZ)) * 0.7;
+    v = RandomVectorNudge(-r, 0.3).unit();
+  }
 
   fParticleGun->SetParticlePosition(r);
-  fParticleGun->SetParticleEnergy(RandomProtonEnergy() * MeV);
+  fParticleGun->SetParticleEnergy(fEnergySampler->Sample());
   fParticleGun->SetParticleMomentumDirection(v);
 
   fParticleGun->GeneratePrimaryVertex(event);
 
+  if (fIsotropic && fTargetBox) {
+    event->GetPrimaryVertex()->SetWeight(fIsotropicWeight);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool PrimaryGeneratorAction::LocateIsotropicTarget()
+{
+  if (fTargetBox) return true;
+
+  G4LogicalVolume* targetLV = G4LogicalVolumeStore::GetInstance()->GetVolume(fTargetName);
+  if (targetLV) fTargetBox = dynamic_cast<G4Box*>(targetLV->GetSolid());
+  if (!fTargetBox || !fEnvelopeBox) {
+    G4ExceptionDescription msg;
+    msg << "Isotropic source target " << fTargetName << " (or World) is not a box.\n";
+    msg << "Falling back to the legacy source.";
+    G4Exception("PrimaryGeneratorAction::LocateIsotropicTarget()", "MyCode0003", JustWarning, msg);
+    fIsotropic = false;
+    return false;
+  }
+
+  const G4double a = 2. * fTargetBox->GetXHalfLength();
+  const G4double b = 2. * fTargetBox->GetYHalfLength();
+  const G4double c = 2. * fTargetBox->GetZHalfLength();
+  fSourceRadius = 0.5 * std::sqrt(a * a + b * b + c * c);
+
+  // For a convex body in an isotropic field the geometric factor is pi * surface
+  // area (Cauchy), while the source disk covers pi R^2 * 4 pi, so the fraction
+  // of source rays that cross the box is S / (4 pi R^2).
+  const G4double surface = 2. * (a * b + b * c + c * a);
+  const G4double geometricFactor = CLHEP::pi * surface;
+  fIsotropicWeight = 4. * CLHEP::pi * fSourceRadius * fSourceRadius / surface;
+
+  CRD_INFO(Generator, "[PrimaryGeneratorAction] Isotropic source on " << fTargetName
+         << ": geometric factor " << geometricFactor / cm2 << " cm2 sr, "
+         << "event weight " << fIsotropicWeight);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::GenerateIsotropicRay(G4ThreeVector& position,
+                                                  G4ThreeVector& direction)
+{
+  // Uniform fluence inside the circumscribed sphere: random direction, then a
+  // uniform point on the disk through the centre perpendicular to it. The ray
+  // test is cheap compared with transporting a miss, so retry until it hits.
+  G4double tNear = 0., tFar = 0.;
+  G4ThreeVector origin;
+  while (true) {
+    direction = RandomUnitSpherePoint();
+    G4ThreeVector u = direction.orthogonal().unit();
+    G4ThreeVector w = direction.cross(u);
+    G4double rho = fSourceRadius * std::sqrt(G4UniformRand());
+    G4double phi = CLHEP::twopi * G4UniformRand();
+    origin = u * (rho * std::cos(phi)) + w * (rho * std::sin(phi)) - direction * fSourceRadius;
+    if (RayBoxIntersection(origin, direction, fTargetBox, tNear, tFar)) break;
+  }
+
+  // Start just inside the world boundary so the shell is traversed in full
+  RayBoxIntersection(origin, direction, fEnvelopeBox, tNear, tFar);
+  position = origin + direction * (tNear + 1. * um);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::BenchmarkEnergySampler(G4int nDraws)
+{
+  if (nDraws <= 0) return;
+  using clock = std::chrono::steady_clock;
+
+  G4double sumOld = 0.;
+  auto start = clock::now();
+  for (G4int i = 0; i < nDraws; i++) sumOld += RandomProtonEnergy() / MeV;
+  std::chrono::duration<G4double> tOld = clock::now() - start;
+
+  G4double sumNew = 0.;
+  start = clock::now();
+  for (G4int i = 0; i < nDraws; i++) sumNew += fEnergySampler->Sample() / MeV;
+  std::chrono::duration<G4double> tNew = clock::now() - start;
+
+  G4cout << "[PrimaryGeneratorAction] Energy sampler benchmark, " << nDraws << " draws:\n"
+         << "  rejection loop: " << nDraws / tOld.count() << " draws/s, mean "
+         << sumOld / nDraws << " MeV\n"
+         << "  alias table:    " << nDraws / tNew.count() << " draws/s, mean "
+         << sumNew / nDraws << " MeV\n"
+         << "  speedup: " << tOld.count() / tNew.count() << "x" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::SetSpectrumFile(const G4String& fileName)
+{
+  auto sampler = SpectrumSampler::LoadCsv(fileName);
+  if (sampler) fEnergySampler = sampler;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::SetSourceMode(const G4String& mode)
+{
+  fIsotropic = (mode == "isotropic");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::SetSourceTarget(const G4String& target)
+{
+  fTargetName = (target == "shell") ? "AluminumShell" : "Scintillator";
+  fTargetBox = nullptr;  // re-derived on the next event
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/source/", "Primary source control");
+
+  auto& benchCmd = fMessenger->DeclareMethod("benchmarkSampler",
+                                             &PrimaryGeneratorAction::BenchmarkEnergySampler,
+                                             "Time the proton energy sampler against the "
+                                             "old rejection loop (runs on each worker "
+                                             "at the start of the next run in MT mode).");
+  benchCmd.SetParameterName("nDraws", true);
+  benchCmd.SetDefaultValue("1000000");
+
+  auto& spectrumCmd = fMessenger->DeclareMethod("spectrumFile",
+                                                &PrimaryGeneratorAction::SetSpectrumFile,
+                                                "Load the proton spectrum from a csv of "
+                                                "(energy [MeV], flux) rows, e.g. proton_dist2.csv.");
+  spectrumCmd.SetParameterName("fileName", false);
+
+  auto& modeCmd = fMessenger->DeclareMethod("mode", &PrimaryGeneratorAction::SetSourceMode,
+                                            "legacy: aimed at the origin from a sphere. "
+                                            "isotropic: isotropic flux, only rays crossing "
+                                            "the target box, weighted by the source rays "
+                                            "each event stands for.");
+  modeCmd.SetParameterName("mode", false);
+  modeCmd.SetCandidates("legacy isotropic");
+
+  auto& targetCmd = fMessenger->DeclareMethod("target", &PrimaryGeneratorAction::SetSourceTarget,
+                                              "Box the isotropic source rays must cross.");
+  targetCmd.SetParameterName("target", false);
+  targetCmd.SetCandidates("scintillator shell");
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -28,83 +28,82 @@
 // Nikita Mazotov, Yale Cubesat, 03/09/2025
 
 #include "RunAction.hh"
+#include "BoxTracer.hh"
+#include "DepositReplay.hh"
+#include "EarlyDecision.hh"
+#include "FrontEnd.hh"
+#include "Log.hh"
+#include "OpticalGovernor.hh"
+#include "OpticalLUT.hh"
+#include "OutputThread.hh"
+#include "ScintillatorResponse.hh"
 #include "G4AccumulableManager.hh"
+#include "G4Run.hh"
 #include "G4RunManager.hh"
-#include <fstream>
 
 namespace B1
 {
 
-// Mutex and global containers (shared across threads)
-G4Mutex RunAction::fAllHitsMutex = G4MUTEX_INITIALIZER;
-std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> RunAction::fGlobalSiPMHits;
-std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> RunAction::fGlobalMCHits;
-std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>> RunAction::fGlobalStepHits;
-
 RunAction::RunAction()
 {
     auto* accumulableManager = G4AccumulableManager::Instance();
     accumulableManager->RegisterAccumulable(fEdep);
+    accumulableManager->RegisterAccumulable(fPrimaryWeight);
+    accumulableManager->RegisterAccumulable(fAccepted);
+    accumulableManager->RegisterAccumulable(fAcceptedWeight);
+    accumulableManager->RegisterAccumulable(OpticalLUT::Instance()->GetCalibrationMap());
+    accumulableManager->RegisterAccumulable(FrontEnd::Instance()->GetSpectrum());
+    accumulableManager->RegisterAccumulable(OpticalGovernor::Instance()->GetStats());
+    accumulableManager->RegisterAccumulable(EarlyDecision::Instance()->GetStats());
+    accumulableManager->RegisterAccumulable(BoxTracer::Instance()->GetStats());
+    DepositReplay::Instance();  // /crd/twopass/ on this thread
+    ScintillatorResponse::Instance();  // /crd/param/ on this thread
 }
 
 void RunAction::BeginOfRunAction(const G4Run*)
 {
-    // Clear global hits at the start of a run
-    G4AutoLock lock(&fAllHitsMutex);
-    fGlobalStepHits.clear();
-    fGlobalSiPMHits.clear();
-    fGlobalMCHits.clear();
-    lock.unlock();
+    // Sizes the light-collection map and threshold spectrum before the
+    // accumulables are reset
+    OpticalLUT::Instance()->BeginOfRun();
+    FrontEnd::Instance()->BeginOfRun();
+    // Master selects the events to replay, workers pick up its selection
+    DepositReplay::Instance()->BeginOfRun(IsMaster());
+    BoxTracer::Instance()->BeginOfRun();
+    EarlyDecision::Instance()->BeginOfRun();
+    ScintillatorResponse::Instance()->BeginOfRun();
 
     auto* accumulableManager = G4AccumulableManager::Instance();
     accumulableManager->Reset();
+
+    // Master (or the only thread in sequential mode) owns the output files
+    if (IsMaster()) OutputThread::Instance()->Start();
 }
 
-void RunAction::EndOfRunAction(const G4Run*)
+void RunAction::EndOfRunAction(const G4Run* run)
 {
     auto* accumulableManager = G4AccumulableManager::Instance();
     accumulableManager->Merge();  // merge thread-local accumulables
 
-    G4cout << "[RunAction] EndOfRunAction: totals before writing: SiPM="
-           << fGlobalSiPMHits.size()
-           << " MC=" << fGlobalMCHits.size()
-           << " Step=" << fGlobalStepHits.size() << G4endl;
-
-    if (!IsMaster()) return;  // only master writes CSV
-
-    std::ofstream outFile("all_hits.csv");
-    outFile << "x,y,z,time,energy,type\n";
-
-    // SiPM hits
-    if (fGlobalSiPMHits.empty()) {
-        outFile << "n/a,n/a,n/a,n/a,n/a,SiPM_EMPTY\n";
-    } else {
-        for (const auto& h : fGlobalSiPMHits)
-            outFile << std::get<0>(h) << "," << std::get<1>(h) << "," << std::get<2>(h)
-                    << "," << std::get<3>(h) << "," << std::get<4>(h) << ",SiPM\n";
-    }
+    if (!IsMaster()) return;  // only master writes the output files
 
-    // MC hits
-    if (fGlobalMCHits.empty()) {
-        outFile << "n/a,n/a,n/a,n/a,n/a,MC_EMPTY\n";
-    } else {
-        for (const auto& h : fGlobalMCHits)
-            outFile << std::get<0>(h) << "," << std::get<1>(h) << "," << std::get<2>(h)
-                    << "," << std::get<3>(h) << "," << std::get<4>(h) << ",MC\n";
+    CRD_INFO(Run, "[RunAction] " << run->GetNumberOfEvent() << " events, "
+           << fPrimaryWeight.GetValue() << " equivalent source rays");
+    if (run->GetNumberOfEvent() > 0 && fPrimaryWeight.GetValue() > 0.) {
+        CRD_INFO(Run, "[RunAction] trigger accepted " << fAccepted.GetValue() << " events ("
+               << 100. * fAccepted.GetValue() / run->GetNumberOfEvent() << "%), "
+               << 100. * fAcceptedWeight.GetValue() / fPrimaryWeight.GetValue()
+               << "% of the source rays");
     }
 
-    // Step hits
-    if (fGlobalStepHits.empty()) {
-        outFile << "n/a,n/a,n/a,n/a,n/a,STEP_EMPTY\n";
-    } else {
-        for (const auto& h : fGlobalStepHits)
-            outFile << std::get<0>(h) << "," << std::get<1>(h) << "," << std::get<2>(h)
-                    << "," << std::get<3>(h) << "," << std::get<4>(h) << ",Step\n";
-    }
+    OpticalLUT::Instance()->EndOfRun();
+    FrontEnd::Instance()->EndOfRun();
+    OpticalGovernor::Instance()->EndOfRun();
+    EarlyDecision::Instance()->EndOfRun();
+    BoxTracer::Instance()->EndOfRun();
 
-    outFile.close();
-    G4cout << "[RunAction] All hits written, total SiPM hits: "
-           << fGlobalSiPMHits.size() << G4endl;
+    // Every worker has finished its events, so this drains everything
+    OutputThread::Instance()->Stop();
+    Log::Flush();
 }
 
 void RunAction::AddEdep(G4double edep)
@@ -112,46 +111,4 @@ void RunAction::AddEdep(G4double edep)
     fEdep += edep;  // thread-safe via G4Accumulable
 }
 
-void RunAction::MergeSiPMHits(const std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>>& hits)
-{
-    if (hits.empty()) {
-        G4cout << "[RunAction] MergeSiPMHits called with 0 hits (no-op)" << G4endl;
-        return;
-    }
-    G4AutoLock lock(&fAllHitsMutex);
-    size_t before = fGlobalSiPMHits.size();
-    fGlobalSiPMHits.insert(fGlobalSiPMHits.end(), hits.begin(), hits.end());
-    G4cout << "[RunAction] MergeSiPMHits: added " << hits.size()
-           << " hits (total now " << fGlobalSiPMHits.size() << ", before " << before << ")" << G4endl;
-}
-
-void RunAction::MergeMCHits(const std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>>& hits)
-{
-    if (hits.empty()) {
-        G4cout << "[RunAction] MergeMCHits called with 0 hits (no-op)" << G4endl;
-        return;
-    }
-    G4AutoLock lock(&fAllHitsMutex);
-    size_t before = fGlobalMCHits.size();
-    fGlobalMCHits.insert(fGlobalMCHits.end(), hits.begin(), hits.end());
-    G4cout << "[RunAction] MergeMCHits: added " << hits.size()
-           << " hits (total now " << fGlobalMCHits.size() << ", before " << before << ")" << G4endl;
-}
-
-void RunAction::MergeStepHits(const std::vector<std::tuple<G4double,G4double,G4double,G4double,G4double>>& hits)
-{
-    if (hits.empty()) {
-        G4cout << "[RunAction] MergeStepHits called with 0 hits (no-op)" << G4endl;
-        return;
-    }
-    G4AutoLock lock(&fAllHitsMutex);
-    size_t before = fGlobalStepHits.size();
-    // TEMPORARILY DISABLED TO AVOID HUGE FILES 
-    // ALSO BECAUSE IDK WHAT IT DOES
-    
-    //fGlobalStepHits.insert(fGlobalStepHits.end(), hits.begin(), hits.end());
-    //G4cout << "[RunAction] MergeStepHits: added " << hits.size()
-    //       << " hits (total now " << fGlobalStepHits.size() << ", before " << before << ")" << G4endl;
-}
-
 } // namespace B1
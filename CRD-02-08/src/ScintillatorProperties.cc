@@ -0,0 +1,51 @@
+// Scintillation constants read from the scintillator material
+// Yale Cubesat
+
+#include "ScintillatorProperties.hh"
+
+#include "G4Material.hh"
+#include "G4MaterialPropertiesTable.hh"
+
+#include <algorithm>
+
+namespace B1
+{
+
+G4bool ScintillatorProperties::Read(const G4Material* material)
+{
+  *this = ScintillatorProperties();
+  auto* mpt = material ? material->GetMaterialPropertiesTable() : nullptr;
+  if (!mpt) return false;
+
+  if (mpt->ConstPropertyExists("SCINTILLATIONYIELD"))
+    yield = mpt->GetConstProperty("SCINTILLATIONYIELD");
+  for (auto key : {"SCINTILLATIONTIMECONSTANT1", "FASTTIMECONSTANT"}) {
+    if (mpt->ConstPropertyExists(key)) {
+      decayTime = mpt->GetConstProperty(key);
+      break;
+    }
+  }
+  spectrum = mpt->GetProperty("SCINTILLATIONCOMPONENT1");
+  if (!spectrum) spectrum = mpt->GetProperty("FASTCOMPONENT");
+  return true;
+}
+
+G4double ScintillatorProperties::MeanEnergy() const
+{
+  if (!spectrum || spectrum->GetVectorLength() < 2) return kPeakEnergy;
+
+  G4double area = 0.;
+  G4double moment = 0.;
+  for (std::size_t i = 1; i < spectrum->GetVectorLength(); i++) {
+    const G4double e0 = spectrum->Energy(i - 1);
+    const G4double e1 = spectrum->Energy(i);
+    const G4double f0 = std::max(0., (*spectrum)[i - 1]);
+    const G4double f1 = std::max(0., (*spectrum)[i]);
+    area += 0.5 * (f0 + f1) * (e1 - e0);
+    // f linear in e: the integral of f e over the segment, exactly
+    moment += (e1 - e0) * (f0 * (2. * e0 + e1) + f1 * (e0 + 2. * e1)) / 6.;
+  }
+  return area > 0. ? moment / area : kPeakEnergy;
+}
+
+}  // namespace B1
@@ -0,0 +1,244 @@
+// Parameterised scintillator response: deposits straight to SiPM photoelectrons
+// Yale Cubesat
+
+#include "ScintillatorResponse.hh"
+
+#include "DepositReplay.hh"
+#include "Log.hh"
+#include "OpticalLUT.hh"
+#include "ScintillatorProperties.hh"
+#include "SiPMSD.hh"
+
+#include "G4Alpha.hh"
+#include "G4Deuteron.hh"
+#include "G4Electron.hh"
+#include "G4EmCalculator.hh"
+#include "G4FastSimulationManager.hh"
+#include "G4FastStep.hh"
+#include "G4FastTrack.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4Material.hh"
+#include "G4ParticleDefinition.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4Poisson.hh"
+#include "G4ProcessTable.hh"
+#include "G4Proton.hh"
+#include "G4Region.hh"
+#include "G4RegionStore.hh"
+#include "G4SDManager.hh"
+#include "G4Step.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Track.hh"
+#include "G4VPhysicalVolume.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+
+namespace B1
+{
+
+ScintillatorResponse* ScintillatorResponse::Instance()
+{
+  static G4ThreadLocal ScintillatorResponse* instance = nullptr;
+  if (!instance) instance = new ScintillatorResponse();
+  return instance;
+}
+
+ScintillatorResponse::ScintillatorResponse()
+  : fThreshold(100. * keV),
+    fBirks(0.126 * mm / MeV),
+    fTransit(0.2 * ns),
+    fTransitSpread(0.15 * ns)
+{
+  DefineCommands();
+}
+
+void ScintillatorResponse::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/crd/param/",
+                                      "Parameterised scintillator response "
+                                      "(/param/activateModel ScintillatorResponse)");
+
+  auto& thresholdCmd = fMessenger->DeclarePropertyWithUnit("threshold", "keV", fThreshold,
+                                                           "Charged particles below this "
+                                                           "kinetic energy are stopped and "
+                                                           "deposit it on the spot.");
+  thresholdCmd.SetParameterName("energy", false);
+  thresholdCmd.SetRange("energy>=0.");
+  thresholdCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& efficiencyCmd = fMessenger->DeclareProperty("efficiency", fEfficiency,
+                                                    "Photoelectrons per scintillation "
+                                                    "photon: light collection x PDE.");
+  efficiencyCmd.SetParameterName("efficiency", false);
+  efficiencyCmd.SetRange("efficiency>=0. && efficiency<=1.");
+  efficiencyCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  // mm/MeV is not a Geant4 unit, and is 1 in internal units
+  auto& birksCmd = fMessenger->DeclareProperty("birks", fBirks,
+                                               "Birks constant in mm/MeV (0: no quenching).");
+  birksCmd.SetParameterName("kB", false);
+  birksCmd.SetRange("kB>=0.");
+  birksCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& transitCmd = fMessenger->DeclarePropertyWithUnit("transit", "ns", fTransit,
+                                                         "Mean photon transit time to "
+                                                         "the SiPM.");
+  transitCmd.SetParameterName("time", false);
+  transitCmd.SetRange("time>=0.");
+  transitCmd.SetStates(G4State_PreInit, G4State_Idle);
+
+  auto& spreadCmd = fMessenger->DeclarePropertyWithUnit("transitSpread", "ns", fTransitSpread,
+                                                        "Sigma of the transit time.");
+  spreadCmd.SetParameterName("sigma", false);
+  spreadCmd.SetRange("sigma>=0.");
+  spreadCmd.SetStates(G4State_PreInit, G4State_Idle);
+}
+
+void ScintillatorResponse::BeginOfRun()
+{
+  fPendingTrack = -1;
+  fLive = Setup();
+
+  // Live, the photons of charged particles would only be killed at
+  // stacking, so they are not made at all; otherwise the light-collection
+  // map and the record pass decide, as their commands do
+  const G4bool optical = !fLive && OpticalLUT::Instance()->GetMode() != OpticalLUT::Mode::Lookup
+                         && DepositReplay::Instance()->GetMode() != DepositReplay::Mode::Record;
+  auto* processTable = G4ProcessTable::GetProcessTable();
+  processTable->SetProcessActivation("Scintillation", optical);
+  processTable->SetProcessActivation("Cerenkov", optical);
+}
+
+G4bool ScintillatorResponse::Setup()
+{
+  // /param/activateModel decides for the whole run. The manager has no
+  // query, but inactivating the model says whether it was active (the
+  // master has no fast-simulation manager)
+  auto* region = G4RegionStore::GetInstance()->GetRegion("ScintillatorRegion", false);
+  auto* manager = region ? region->GetFastSimulationManager() : nullptr;
+  if (!manager || !manager->InActivateFastSimulationModel("ScintillatorResponse")) return false;
+  manager->ActivateFastSimulationModel("ScintillatorResponse");
+
+  // Photoelectrons go to this thread's SiPM detector (none on the master)
+  fSiPMSD = static_cast<SiPMSD*>(
+    G4SDManager::GetSDMpointer()->FindSensitiveDetector("SiPM_SD", false));
+
+  auto* scintLV = G4LogicalVolumeStore::GetInstance()->GetVolume("Scintillator", false);
+  auto* sipmPV = G4PhysicalVolumeStore::GetInstance()->GetVolume("PhotonDetector", false);
+  if (!scintLV || !sipmPV) {
+    G4Exception("ScintillatorResponse::BeginOfRun()", "ScintResponse001", JustWarning,
+                "Scintillator or PhotonDetector not found, no photoelectrons.");
+    fSiPMSD = nullptr;
+    return false;
+  }
+  fMaterial = scintLV->GetMaterial();
+  fSiPMPosition = sipmPV->GetTranslation();
+  fChannel = sipmPV->GetCopyNo();
+
+  // Hits carry the mean energy of the emission spectrum
+  ScintillatorProperties scintillator;
+  scintillator.Read(fMaterial);
+  fYield = scintillator.yield;
+  fDecayTime = scintillator.decayTime;
+  fPhotonEnergy = scintillator.MeanEnergy();
+
+  if (fYield <= 0.) {
+    G4Exception("ScintillatorResponse::BeginOfRun()", "ScintResponse002", JustWarning,
+                "Scintillator material has no SCINTILLATIONYIELD, no photoelectrons.");
+  }
+  return fSiPMSD != nullptr;
+}
+
+G4double ScintillatorResponse::Quench(const G4Track* track) const
+{
+  const G4double energy = track->GetKineticEnergy();
+  if (fBirks <= 0. || energy <= 0.) return energy;
+
+  // Midpoint rule over the slowing down, dE / (1 + kB dE/dx)
+  const G4int intervals = 10;
+  const G4double width = energy / intervals;
+  const auto* particle = track->GetDefinition();
+  G4double visible = 0.;
+  for (G4int i = 0; i < intervals; i++) {
+    const G4double dedx = fCalculator->GetDEDX((i + 0.5) * width, particle, fMaterial);
+    visible += width / (1. + fBirks * dedx);
+  }
+  return visible;
+}
+
+void ScintillatorResponse::Stop(const G4Track* track)
+{
+  if (!fCalculator) fCalculator = new G4EmCalculator();
+  fPendingTrack = track->GetTrackID();
+  fPendingVisible = fMaterial ? Quench(track) : track->GetKineticEnergy();
+}
+
+void ScintillatorResponse::Convert(const G4Step* step)
+{
+  const G4double edep = step->GetTotalEnergyDeposit();
+  if (!fSiPMSD || edep <= 0.) return;
+
+  const auto* track = step->GetTrack();
+  const G4double length = step->GetStepLength();
+  G4double visible = edep;
+  if (track->GetTrackID() == fPendingTrack) {
+    visible = fPendingVisible;
+    fPendingTrack = -1;
+  }
+  else if (track->GetDefinition()->GetPDGCharge() != 0. && length > 0.) {
+    visible = edep / (1. + fBirks * edep / length);
+  }
+
+  const auto* pre = step->GetPreStepPoint();
+  const auto* post = step->GetPostStepPoint();
+  const G4double t0 = pre->GetGlobalTime();
+  const G4double dt = post->GetGlobalTime() - t0;
+  const G4long nDetected = G4Poisson(fYield * visible * fEfficiency);
+
+  for (G4long i = 0; i < nDetected; i++) {
+    G4double time = t0 + G4UniformRand() * dt;
+    if (fDecayTime > 0.) time += G4RandExponential::shoot(fDecayTime);
+    const G4double transit =
+      fTransitSpread > 0. ? G4RandGauss::shoot(fTransit, fTransitSpread) : fTransit;
+    time += std::max(0., transit);
+
+    // As for the light-collection map: the hit is at the SiPM centre and
+    // carries the ID of the charged track that made the light
+    fSiPMSD->RecordPhoton(fSiPMPosition, time, fPhotonEnergy, fChannel, track->GetTrackID());
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ScintillatorResponseModel::ScintillatorResponseModel(G4Region* envelope)
+  : G4VFastSimulationModel("ScintillatorResponse", envelope)
+{}
+
+G4bool ScintillatorResponseModel::IsApplicable(const G4ParticleDefinition& particle)
+{
+  // Killing the track skips its at-rest processes, so only particles that
+  // have none: no Michel electrons or capture products go missing
+  return &particle == G4Electron::Definition() || &particle == G4Proton::Definition()
+         || &particle == G4Deuteron::Definition() || &particle == G4Alpha::Definition();
+}
+
+G4bool ScintillatorResponseModel::ModelTrigger(const G4FastTrack& fastTrack)
+{
+  return fastTrack.GetPrimaryTrack()->GetKineticEnergy()
+         < ScintillatorResponse::Instance()->GetThreshold();
+}
+
+void ScintillatorResponseModel::DoIt(const G4FastTrack& fastTrack, G4FastStep& fastStep)
+{
+  const auto* track = fastTrack.GetPrimaryTrack();
+  ScintillatorResponse::Instance()->Stop(track);
+
+  fastStep.KillPrimaryTrack();
+  fastStep.ProposePrimaryTrackPathLength(0.);
+  fastStep.ProposeTotalEnergyDeposited(track->GetKineticEnergy());
+}
+
+}  // namespace B1
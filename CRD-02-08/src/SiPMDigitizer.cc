@@ -0,0 +1,109 @@
+// SiPM microcell digitizer
+// Yale Cubesat
+
+#include "SiPMDigitizer.hh"
+
+#include "G4Poisson.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace B1
+{
+
+void SiPMDigitizer::Clear()
+{
+  fPhotons.clear();
+}
+
+void SiPMDigitizer::AddPhoton(G4double time)
+{
+  fPhotons.push_back(time);
+}
+
+void SiPMDigitizer::AddPhotons(G4double binStart, G4double binWidth, G4int count)
+{
+  for (G4int i = 0; i < count; i++) fPhotons.push_back(binStart + G4UniformRand() * binWidth);
+}
+
+G4int SiPMDigitizer::RandomCell(G4int cells) const
+{
+  return std::min(static_cast<G4int>(G4UniformRand() * cells), cells - 1);
+}
+
+G4int SiPMDigitizer::Neighbour(G4int cell, G4int cells) const
+{
+  // Cells on a square grid, row by row; off the edge means no crosstalk
+  const G4int side = std::max(1, static_cast<G4int>(std::lround(std::sqrt(cells))));
+  const G4int row = cell / side, column = cell % side;
+  switch (static_cast<G4int>(G4UniformRand() * 4)) {
+    case 0: return column > 0 ? cell - 1 : -1;
+    case 1: return column < side - 1 && cell + 1 < cells ? cell + 1 : -1;
+    case 2: return row > 0 ? cell - side : -1;
+    default: return cell + side < cells ? cell + side : -1;
+  }
+}
+
+void SiPMDigitizer::Digitize(const SiPMResponse& response, SiPMSignal& signal)
+{
+  signal = SiPMSignal();
+  fHeap.clear();
+  fFired.clear();
+  fPulses.clear();
+
+  const G4int cells = response.cells;
+  for (auto time : fPhotons) fHeap.push_back({time, RandomCell(cells)});
+  fPhotons.clear();
+
+  const G4long darkCounts = G4Poisson(response.darkRate * response.gate);
+  for (G4long i = 0; i < darkCounts; i++)
+    fHeap.push_back({G4UniformRand() * response.gate, RandomCell(cells)});
+  signal.darkCounts = darkCounts;
+
+  auto later = std::greater<Avalanche>();
+  std::make_heap(fHeap.begin(), fHeap.end(), later);
+  while (!fHeap.empty()) {
+    std::pop_heap(fHeap.begin(), fHeap.end(), later);
+    const Avalanche avalanche = fHeap.back();
+    fHeap.pop_back();
+    if (avalanche.time > response.gate) continue;  // later ones only add afterpulses
+
+    // A cell that is still recharging gives a smaller avalanche
+    auto fired = fFired.try_emplace(avalanche.cell, avalanche.time);
+    G4double charge = 1.;
+    if (!fired.second) {
+      charge = -std::expm1(-(avalanche.time - fired.first->second) / response.recoveryTime);
+      fired.first->second = avalanche.time;
+    }
+    if (avalanche.time >= 0.) {
+      const G4bool crossed = signal.charge < response.timingThreshold;
+      signal.charge += charge;
+      fPulses.push_back({avalanche.time, charge});
+      if (crossed && signal.charge >= response.timingThreshold) {
+        signal.time = avalanche.time;
+        signal.timed = true;
+      }
+    }
+
+    if (G4UniformRand() < response.crosstalk * charge) {
+      G4int neighbour = Neighbour(avalanche.cell, cells);
+      if (neighbour >= 0) {
+        fHeap.push_back({avalanche.time, neighbour});
+        std::push_heap(fHeap.begin(), fHeap.end(), later);
+        signal.crosstalk++;
+      }
+    }
+    if (G4UniformRand() < response.afterpulse * charge) {
+      fHeap.push_back({avalanche.time + G4RandExponential::shoot(response.afterpulseTime),
+                       avalanche.cell});
+      std::push_heap(fHeap.begin(), fHeap.end(), later);
+      signal.afterpulses++;
+    }
+  }
+  signal.firedCells = fFired.size();
+}
+
+}  // namespace B1
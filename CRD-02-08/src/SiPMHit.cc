@@ -0,0 +1,21 @@
+// SiPM photon hit
+// Yale Cubesat
+
+#include "SiPMHit.hh"
+
+#include "G4SystemOfUnits.hh"
+#include "G4UnitsTable.hh"
+
+namespace B1
+{
+
+G4ThreadLocal G4Allocator<SiPMHit>* SiPMHitAllocator = nullptr;
+
+void SiPMHit::Print()
+{
+  G4cout << "  SiPM " << fChannel << " track " << fTrackID << ": "
+         << G4BestUnit(fPosition, "Length") << " t=" << G4BestUnit(fTime, "Time")
+         << " E=" << G4BestUnit(fEnergy, "Energy") << G4endl;
+}
+
+}  // namespace B1
@@ -0,0 +1,262 @@
+// SiPM readout settings and the compressed arrival-time histogram
+// Yale Cubesat
+
+#include "SiPMReadout.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace B1
+{
+
+void TimeHistogram::Configure(G4double binWidth, G4int nBins)
+{
+  fBinWidth = binWidth;
+  fCounts.assign(nBins, 0);
+  fTouched.clear();
+  fTotal = fOverflow = 0;
+}
+
+void TimeHistogram::Fill(G4double time)
+{
+  if (fTotal == 0 || time < fFirstTime) fFirstTime = time;
+  fTotal++;
+
+  G4double x = time / fBinWidth;
+  if (x < 0. || x >= fCounts.size()) {
+    fOverflow++;
+    return;
+  }
+  auto bin = static_cast<std::int32_t>(x);
+  if (fCounts[bin]++ == 0) fTouched.push_back(bin);
+}
+
+void TimeHistogram::Clear()
+{
+  for (auto bin : fTouched) fCounts[bin] = 0;
+  fTouched.clear();
+  fTotal = fOverflow = 0;
+}
+
+G4double TimeHistogram::GetMedianTime() const
+{
+  const G4int inWindow = fTotal - fOverflow;
+  if (inWindow == 0) return 0.;
+  std::sort(fTouched.begin(), fTouched.end());
+  G4int seen = 0;
+  for (auto bin : fTouched) {
+    seen += fCounts[bin];
+    if (2 * seen >= inWindow) return (bin + 0.5) * fBinWidth;
+  }
+  return (fTouched.back() + 0.5) * fBinWidth;
+}
+
+void TimeHistogram::GetNonZero(std::vector<std::int32_t>& bins,
+                               std::vector<std::int32_t>& counts) const
+{
+  std::sort(fTouched.begin(), fTouched.end());
+  bins.assign(fTouched.begin(), fTouched.end());
+  counts.clear();
+  for (auto bin : fTouched) counts.push_back(fCounts[bin]);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SiPMReadout* SiPMReadout::Instance()
+{
+  static SiPMReadout* instance = new SiPMReadout();
+  return instance;
+}
+
+SiPMReadout::SiPMReadout() : fBinWidth(1. * ns), fWindow(200. * ns)
+{
+  fResponse.recoveryTime = 50. * ns;
+  fResponse.afterpulseTime = 20. * ns;
+  fResponse.darkRate = 1.8 * megahertz;  // 50 kHz/mm2 over 6 x 6 mm2
+  fResponse.gate = 200. * ns;
+  fWaveform.period = 1. * ns;
+  fWaveform.riseTime = 1. * ns;
+  fWaveform.fallTime = 50. * ns;
+  DefineCommands();
+}
+
+G4int SiPMReadout::GetNumberOfBins() const
+{
+  return std::max(1, static_cast<G4int>(std::ceil(fWindow / fBinWidth)));
+}
+
+void SiPMReadout::DefineCommands()
+{
+  // Read by the workers when the run starts, so nothing is broadcast
+  fMessenger = new G4GenericMessenger(this, "/crd/sipm/", "SiPM readout");
+
+  auto& modeCmd = fMessenger->DeclareMethod("readout", &SiPMReadout::SetMode,
+                                            "hits: one hit per detected photon. "
+                                            "histogram: only a per-event arrival-time "
+                                            "histogram and the photon count are kept.");
+  modeCmd.SetParameterName("mode", false);
+  modeCmd.SetCandidates("hits histogram");
+  modeCmd.SetStates(G4State_PreInit, G4State_Idle);
+  modeCmd.SetToBeBroadcasted(false);
+
+  auto& binCmd = fMessenger->DeclarePropertyWithUnit("binWidth", "ns", fBinWidth,
+                                                     "Arrival-time histogram bin width.");
+  binCmd.SetParameterName("width", false);
+  binCmd.SetRange("width>0.");
+  binCmd.SetStates(G4State_PreInit, G4State_Idle);
+  binCmd.SetToBeBroadcasted(false);
+
+  auto& windowCmd = fMessenger->DeclarePropertyWithUnit("window", "ns", fWindow,
+                                                        "Arrival-time histogram length from "
+                                                        "the primary vertex; later photons "
+                                                        "are only counted.");
+  windowCmd.SetParameterName("window", false);
+  windowCmd.SetRange("window>0.");
+  windowCmd.SetStates(G4State_PreInit, G4State_Idle);
+  windowCmd.SetToBeBroadcasted(false);
+
+  fDigiMessenger = new G4GenericMessenger(&fResponse, "/crd/sipm/digi/",
+                                          "SiPM microcell digitization");
+
+  auto& digiCmd = fDigiMessenger->DeclareProperty("enable", fResponse.digitize,
+                                                  "Digitize the detected photons into "
+                                                  "a charge and time per event.");
+  digiCmd.SetParameterName("digitize", false);
+  digiCmd.SetStates(G4State_PreInit, G4State_Idle);
+  digiCmd.SetToBeBroadcasted(false);
+
+  auto& cellsCmd = fDigiMessenger->DeclareProperty("cells", fResponse.cells,
+                                                   "Microcells of the SiPM.");
+  cellsCmd.SetParameterName("cells", false);
+  cellsCmd.SetRange("cells>0");
+  cellsCmd.SetStates(G4State_PreInit, G4State_Idle);
+  cellsCmd.SetToBeBroadcasted(false);
+
+  auto& recoveryCmd = fDigiMessenger->DeclarePropertyWithUnit(
+    "recoveryTime", "ns", fResponse.recoveryTime, "Microcell recharge time constant.");
+  recoveryCmd.SetParameterName("tau", false);
+  recoveryCmd.SetRange("tau>0.");
+  recoveryCmd.SetStates(G4State_PreInit, G4State_Idle);
+  recoveryCmd.SetToBeBroadcasted(false);
+
+  auto& crosstalkCmd = fDigiMessenger->DeclareProperty("crosstalk", fResponse.crosstalk,
+                                                       "Probability that an avalanche "
+                                                       "fires a neighbouring cell.");
+  crosstalkCmd.SetParameterName("p", false);
+  crosstalkCmd.SetRange("p>=0. && p<1.");
+  crosstalkCmd.SetStates(G4State_PreInit, G4State_Idle);
+  crosstalkCmd.SetToBeBroadcasted(false);
+
+  auto& afterpulseCmd = fDigiMessenger->DeclareProperty("afterpulse", fResponse.afterpulse,
+                                                        "Probability that an avalanche is "
+                                                        "followed by an afterpulse.");
+  afterpulseCmd.SetParameterName("p", false);
+  afterpulseCmd.SetRange("p>=0. && p<1.");
+  afterpulseCmd.SetStates(G4State_PreInit, G4State_Idle);
+  afterpulseCmd.SetToBeBroadcasted(false);
+
+  auto& afterpulseTimeCmd = fDigiMessenger->DeclarePropertyWithUnit(
+    "afterpulseTime", "ns", fResponse.afterpulseTime, "Mean delay of an afterpulse.");
+  afterpulseTimeCmd.SetParameterName("tau", false);
+  afterpulseTimeCmd.SetRange("tau>0.");
+  afterpulseTimeCmd.SetStates(G4State_PreInit, G4State_Idle);
+  afterpulseTimeCmd.SetToBeBroadcasted(false);
+
+  auto& darkCmd = fDigiMessenger->DeclarePropertyWithUnit("darkRate", "MHz", fResponse.darkRate,
+                                                          "Dark count rate of the whole SiPM.");
+  darkCmd.SetParameterName("rate", false);
+  darkCmd.SetRange("rate>=0.");
+  darkCmd.SetStates(G4State_PreInit, G4State_Idle);
+  darkCmd.SetToBeBroadcasted(false);
+
+  auto& gateCmd = fDigiMessenger->DeclarePropertyWithUnit("gate", "ns", fResponse.gate,
+                                                          "Charge integration window from "
+                                                          "the primary vertex.");
+  gateCmd.SetParameterName("gate", false);
+  gateCmd.SetRange("gate>0.");
+  gateCmd.SetStates(G4State_PreInit, G4State_Idle);
+  gateCmd.SetToBeBroadcasted(false);
+
+  auto& thresholdCmd = fDigiMessenger->DeclareProperty("timingThreshold",
+                                                       fResponse.timingThreshold,
+                                                       "Charge in p.e. at which the signal "
+                                                       "time is taken.");
+  thresholdCmd.SetParameterName("pe", false);
+  thresholdCmd.SetRange("pe>0.");
+  thresholdCmd.SetStates(G4State_PreInit, G4State_Idle);
+  thresholdCmd.SetToBeBroadcasted(false);
+
+  fWaveMessenger = new G4GenericMessenger(&fWaveform, "/crd/sipm/wave/", "SiPM waveforms");
+
+  auto& waveCmd = fWaveMessenger->DeclareProperty("enable", fWaveform.enable,
+                                                  "Write a sampled waveform per event to "
+                                                  "waveforms.crdh.");
+  waveCmd.SetParameterName("write", false);
+  waveCmd.SetStates(G4State_PreInit, G4State_Idle);
+  waveCmd.SetToBeBroadcasted(false);
+
+  auto& periodCmd = fWaveMessenger->DeclarePropertyWithUnit("period", "ns", fWaveform.period,
+                                                            "Sample spacing.");
+  periodCmd.SetParameterName("period", false);
+  periodCmd.SetRange("period>0.");
+  periodCmd.SetStates(G4State_PreInit, G4State_Idle);
+  periodCmd.SetToBeBroadcasted(false);
+
+  auto& samplesCmd = fWaveMessenger->DeclareProperty("samples", fWaveform.samples,
+                                                     "Samples per waveform, from the "
+                                                     "primary vertex.");
+  samplesCmd.SetParameterName("samples", false);
+  samplesCmd.SetRange("samples>0");
+  samplesCmd.SetStates(G4State_PreInit, G4State_Idle);
+  samplesCmd.SetToBeBroadcasted(false);
+
+  auto& batchCmd = fWaveMessenger->DeclareProperty("batch", fWaveform.batch,
+                                                   "Events convolved per call and written "
+                                                   "as one row group.");
+  batchCmd.SetParameterName("events", false);
+  batchCmd.SetRange("events>0");
+  batchCmd.SetStates(G4State_PreInit, G4State_Idle);
+  batchCmd.SetToBeBroadcasted(false);
+
+  auto& riseCmd = fWaveMessenger->DeclarePropertyWithUnit("riseTime", "ns", fWaveform.riseTime,
+                                                          "Rise time constant of the "
+                                                          "single-p.e. pulse.");
+  riseCmd.SetParameterName("tau", false);
+  riseCmd.SetRange("tau>0.");
+  riseCmd.SetStates(G4State_PreInit, G4State_Idle);
+  riseCmd.SetToBeBroadcasted(false);
+
+  auto& fallCmd = fWaveMessenger->DeclarePropertyWithUnit("fallTime", "ns", fWaveform.fallTime,
+                                                          "Decay time constant of the "
+                                                          "single-p.e. pulse.");
+  fallCmd.SetParameterName("tau", false);
+  fallCmd.SetRange("tau>0.");
+  fallCmd.SetStates(G4State_PreInit, G4State_Idle);
+  fallCmd.SetToBeBroadcasted(false);
+
+  // Geant4 has no millivolt unit, so this one is a plain number in mV
+  auto& amplitudeCmd = fWaveMessenger->DeclareProperty("speAmplitude", fWaveform.speAmplitude,
+                                                       "Peak height of the single-p.e. "
+                                                       "pulse in mV.");
+  amplitudeCmd.SetParameterName("height", false);
+  amplitudeCmd.SetStates(G4State_PreInit, G4State_Idle);
+  amplitudeCmd.SetToBeBroadcasted(false);
+
+  auto& speFileCmd = fWaveMessenger->DeclareProperty("speFile", fWaveform.speFile,
+                                                     "Measured single-p.e. pulse, rows of "
+                                                     "time in ns and amplitude; \"none\" "
+                                                     "for the two-exponential shape.");
+  speFileCmd.SetParameterName("file", false);
+  speFileCmd.SetStates(G4State_PreInit, G4State_Idle);
+  speFileCmd.SetToBeBroadcasted(false);
+}
+
+void SiPMReadout::SetMode(const G4String& mode)
+{
+  fMode = (mode == "histogram") ? Mode::Histogram : Mode::Hits;
+}
+
+}  // namespace B1
@@ -6,17 +6,60 @@
 #include "G4ParticleDefinition.hh"
 #include "G4OpticalPhoton.hh"
 #include "G4StepPoint.hh"
+#include "G4Material.hh"
+#include "G4MaterialPropertiesTable.hh"
 #include "G4SystemOfUnits.hh"
-#include "G4EventManager.hh"
-#include "G4RunManager.hh"
-#include "EventAction.hh"
-#include <tuple>
-#include <vector>
+#include "G4SDManager.hh"
+#include "Log.hh"
+#include "OpticalGovernor.hh"
+#include "OpticalLUT.hh"
+#include "Randomize.hh"
 
 using namespace B1;
 
 SiPMSD::SiPMSD(const G4String& name)
-  : G4VSensitiveDetector(name) {}
+  : G4VSensitiveDetector(name) {
+  collectionName.insert("SiPMHitsCollection");
+}
+
+void SiPMSD::Initialize(G4HCofThisEvent* hce) {
+  fHitsCollection = new SiPMHitsCollection(SensitiveDetectorName, collectionName[0]);
+  if (fHCID < 0) fHCID = G4SDManager::GetSDMpointer()->GetCollectionID(fHitsCollection);
+  hce->AddHitsCollection(fHCID, fHitsCollection);
+
+  // Histogram settings can change between runs
+  auto* readout = SiPMReadout::Instance();
+  fHistogramMode = readout->GetMode() == SiPMReadout::Mode::Histogram;
+  if (!fHistogramMode) return;
+  if (fTimeHistogram.GetBinWidth() != readout->GetBinWidth()
+      || fTimeHistogram.GetNumberOfBins() != readout->GetNumberOfBins()) {
+    fTimeHistogram.Configure(readout->GetBinWidth(), readout->GetNumberOfBins());
+  } else {
+    fTimeHistogram.Clear();
+  }
+}
+
+void SiPMSD::RecordPhoton(const G4ThreeVector& position, G4double time, G4double energy,
+                          G4int channel, G4int trackID) {
+  if (fHistogramMode) {
+    fTimeHistogram.Fill(time);
+    return;
+  }
+  // Pool-allocated hit; the channel is the SiPM copy number
+  fHitsCollection->insert(new SiPMHit(position, time, energy, channel, trackID));
+}
+
+void SiPMSD::RecordWeighted(const G4ThreeVector& position, G4double time, G4double energy,
+                            G4int channel, G4int trackID, G4double weight,
+                            const PhotonOrigin* origin) {
+  G4int copies = static_cast<G4int>(weight);
+  if (weight > copies && G4UniformRand() < weight - copies) copies++;
+  auto* governor = OpticalGovernor::Instance();
+  for (G4int i = 0; i < copies; i++) {
+    const G4double copyTime = (origin && i > 0) ? governor->CopyTime(*origin, time) : time;
+    RecordPhoton(position, copyTime, energy, channel, trackID);
+  }
+}
 
 G4bool SiPMSD::ProcessHits(G4Step* step, G4TouchableHistory*) {
 
@@ -27,87 +70,48 @@ G4bool SiPMSD::ProcessHits(G4Step* step, G4TouchableHistory*) {
   auto preStep = step->GetPreStepPoint();
   auto track = step->GetTrack();
 
-  // Diagnostic: step status
+  // Diagnostic: step and track status
   G4StepStatus stepStatus = preStep->GetStepStatus();
-  switch (stepStatus) {
-    case fGeomBoundary:
-      G4cout << "[SiPMSD] StepStatus: fGeomBoundary at pos " 
-             << preStep->GetPosition() << " time = " 
-             << preStep->GetGlobalTime()/ns << " ns" << G4endl;
-      break;
-    case fPostStepDoItProc:
-      G4cout << "[SiPMSD] StepStatus: fPostStepDoItProc at pos " 
-             << preStep->GetPosition() << G4endl;
-      break;
-    case fAtRestDoItProc:
-      G4cout << "[SiPMSD] StepStatus: fAtRestDoItProc at pos " 
-             << preStep->GetPosition() << G4endl;
-      break;
-    case fUndefined:
-      G4cout << "[SiPMSD] StepStatus: fUndefined at pos " 
-             << preStep->GetPosition() << G4endl;
-      break;
-    default:
-      G4cout << "[SiPMSD] StepStatus: " << stepStatus 
-             << " at pos " << preStep->GetPosition() << G4endl;
-      break;
-  }
+  CRD_TRACE(SD, "[SiPMSD] StepStatus: " << stepStatus
+                << " TrackStatus: " << track->GetTrackStatus()
+                << " at pos " << preStep->GetPosition()
+                << " time = " << preStep->GetGlobalTime()/ns << " ns");
 
-  // Diagnostic: track status
-  G4TrackStatus trackStatus = track->GetTrackStatus();
-  switch (trackStatus) {
-    case fAlive:
-      // optional: usually lots of alive tracks
-      break;
-    case fStopAndKill:
-      G4cout << "[SiPMSD] TrackStatus: fStopAndKill at pos "
-             << preStep->GetPosition() << G4endl;
-      break;
-    case fSuspend:
-      G4cout << "[SiPMSD] TrackStatus: fSuspend at pos "
-             << preStep->GetPosition() << G4endl;
-      break;
-    case fKillTrackAndSecondaries:
-      G4cout << "[SiPMSD] TrackStatus: fKillTrackAndSecondaries at pos "
-             << preStep->GetPosition() << G4endl;
-      break;
-    default:
-      G4cout << "[SiPMSD] TrackStatus: " << trackStatus 
-             << " at pos " << preStep->GetPosition() << G4endl;
-      break;
-  }
-
-  // Only register hits at geometry boundary
-  //if (stepStatus == fGeomBoundary) {
+  // One detection per photon: only the step entering the SiPM counts, and the
+  // photon is absorbed there whether or not it fires a cell
+  if (stepStatus != fGeomBoundary) return false;
+  track->SetTrackStatus(fStopAndKill);
 
-  // Retrieve current EventAction
-  auto evtAction = static_cast<B1::EventAction*>(
-      G4EventManager::GetEventManager()->GetUserEventAction());
-  if (!evtAction) return false;
+  // Photon detection efficiency from the "PDE" table of the SiPM material
+  if (!fPDE) {
+    auto* mpt = preStep->GetMaterial()->GetMaterialPropertiesTable();
+    fPDE = mpt ? mpt->GetProperty("PDE") : nullptr;
+  }
+  if (fPDE && G4UniformRand() >= fPDE->Value(track->GetKineticEnergy())) return false;
 
-  // Build tuple for this hit
-  auto hitTuple = std::make_tuple(
-    preStep->GetPosition().x() / CLHEP::mm,     // mm
-    preStep->GetPosition().y() / CLHEP::mm,     // mm
-    preStep->GetPosition().z() / CLHEP::mm,     // mm
-    preStep->GetGlobalTime() / CLHEP::ns,       // ns
-    track->GetKineticEnergy() / CLHEP::eV       // eV
-);
+  // Light-collection map calibration counts detected photons
+  auto* opticalLUT = OpticalLUT::Instance();
+  if (opticalLUT->GetMode() == OpticalLUT::Mode::Calibrate) {
+    opticalLUT->RecordDetection(track);
+  }
 
-  // Add hit to EventAction
-  evtAction->AddSiPMHit(hitTuple);
+  // A photon that survived the governor's roulette or reduced yield stands
+  // for several
+  auto* governor = OpticalGovernor::Instance();
+  RecordWeighted(preStep->GetPosition(), preStep->GetGlobalTime(), track->GetKineticEnergy(),
+                 preStep->GetTouchableHandle()->GetCopyNumber(), track->GetTrackID(),
+                 governor->GetPhotonWeight(track), governor->GetOrigin(track));
 
-  G4cout << "[SiPMSD] Recorded photon hit at "
+  CRD_TRACE(SD, "[SiPMSD] Recorded photon hit at "
           << preStep->GetPosition()
-          << " time = " << preStep->GetGlobalTime()/ns 
-          << " ns, energy = " << track->GetKineticEnergy()/eV << " eV"
-          << G4endl;
-//}
+          << " time = " << preStep->GetGlobalTime()/ns
+          << " ns, energy = " << track->GetKineticEnergy()/eV << " eV");
 
   return true;
 }
 
 void SiPMSD::EndOfEvent(G4HCofThisEvent*) {
-  // Nothing else needed: EventAction will merge hits into RunAction
-  G4cout << "[SiPMSD] EndOfEvent called." << G4endl;
+  // EventAction reads the collection by ID at the end of the event
+  CRD_DEBUG(SD, "[SiPMSD] EndOfEvent: " << fHitsCollection->entries() << " hits, "
+          << fTimeHistogram.GetTotal() << " in the time histogram");
 }
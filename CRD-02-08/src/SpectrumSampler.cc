@@ -0,0 +1,163 @@
+// Tabulated energy spectrum sampler (Walker alias method)
+// Yale Cubesat
+
+#include "SpectrumSampler.hh"
+
+#include "G4AutoLock.hh"
+#include "G4SystemOfUnits.hh"
+#include "Log.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <utility>
+
+namespace B1
+{
+
+namespace
+{
+G4Mutex spectrumCacheMutex = G4MUTEX_INITIALIZER;
+std::map<G4String, std::shared_ptr<const SpectrumSampler>> spectrumCache;
+}
+
+void SpectrumSampler::Build(const std::function<G4double(G4double)>& density,
+                            G4double eMin, G4double eMax, G4int nBins, G4bool logBins)
+{
+  fProb.clear();
+  fAlias.clear();
+  if (nBins <= 0 || eMax <= eMin || (logBins && eMin <= 0.)) {
+    G4Exception("SpectrumSampler::Build()", "Spectrum001", FatalException,
+                "Invalid energy range or bin count for spectrum table.");
+    return;
+  }
+
+  fEMin = eMin;
+  fEMax = eMax;
+  fLogBins = logBins;
+  fLo = logBins ? std::log(eMin) : eMin;
+  fBinWidth = ((logBins ? std::log(eMax) : eMax) - fLo) / nBins;
+
+  // Density per unit of the binning variable; dE = E dlnE in log mode
+  auto binDensity = [&](G4double x) {
+    if (!logBins) return std::max(0., density(x));
+    G4double energy = std::exp(x);
+    return std::max(0., density(energy)) * energy;
+  };
+
+  // Bin weights: Simpson's rule over each bin, negative densities count as 0
+  std::vector<G4double> weight(nBins);
+  G4double total = 0.;
+  for (G4int i = 0; i < nBins; i++) {
+    G4double lo = fLo + i * fBinWidth;
+    weight[i] = (binDensity(lo) + 4. * binDensity(lo + 0.5 * fBinWidth)
+                 + binDensity(lo + fBinWidth)) / 6.;
+    total += weight[i];
+  }
+  if (total <= 0.) {
+    G4Exception("SpectrumSampler::Build()", "Spectrum002", FatalException,
+                "Spectrum density integrates to zero.");
+    return;
+  }
+
+  // Vose's construction of the alias table
+  fProb.assign(nBins, 1.);
+  fAlias.resize(nBins);
+  std::vector<G4int> small, large;
+  for (G4int i = 0; i < nBins; i++) {
+    weight[i] *= nBins / total;
+    fAlias[i] = i;
+    (weight[i] < 1. ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    G4int s = small.back();
+    small.pop_back();
+    G4int l = large.back();
+    fProb[s] = weight[s];
+    fAlias[s] = l;
+    weight[l] -= 1. - weight[s];
+    if (weight[l] < 1.) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // Whatever is left over is 1 up to rounding
+}
+
+std::shared_ptr<const SpectrumSampler> SpectrumSampler::LoadCsv(const G4String& fileName,
+                                                                G4int nBins)
+{
+  G4AutoLock lock(&spectrumCacheMutex);
+  auto cached = spectrumCache.find(fileName);
+  if (cached != spectrumCache.end()) return cached->second;
+
+  std::ifstream in(fileName);
+  if (!in.is_open()) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open spectrum file " << fileName << ", keeping current spectrum.";
+    G4Exception("SpectrumSampler::LoadCsv()", "Spectrum003", JustWarning, msg);
+    return nullptr;
+  }
+
+  // Rows are "energy, flux"; anything that does not parse (headers, comments)
+  // is skipped, and log-log interpolation needs both columns positive.
+  std::vector<std::pair<G4double, G4double>> points;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::istringstream fields(line);
+    G4double energy = 0., flux = 0.;
+    if (!(fields >> energy >> flux)) continue;
+    if (energy <= 0. || flux <= 0.) continue;
+    points.emplace_back(energy * MeV, flux);
+  }
+  std::sort(points.begin(), points.end());
+
+  if (points.size() < 2) {
+    G4ExceptionDescription msg;
+    msg << "Spectrum file " << fileName << " has fewer than two usable rows, "
+        << "keeping current spectrum.";
+    G4Exception("SpectrumSampler::LoadCsv()", "Spectrum004", JustWarning, msg);
+    return nullptr;
+  }
+
+  std::vector<G4double> logE, logFlux;
+  for (const auto& p : points) {
+    logE.push_back(std::log(p.first));
+    logFlux.push_back(std::log(p.second));
+  }
+
+  auto flux = [&](G4double energy) {
+    G4double x = std::log(energy);
+    auto it = std::upper_bound(logE.begin(), logE.end(), x);
+    size_t i = std::clamp<size_t>(it - logE.begin(), 1, logE.size() - 1) - 1;
+    G4double dx = logE[i + 1] - logE[i];
+    G4double t = dx > 0. ? (x - logE[i]) / dx : 0.;
+    return std::exp(logFlux[i] + t * (logFlux[i + 1] - logFlux[i]));
+  };
+
+  auto sampler = std::make_shared<SpectrumSampler>();
+  sampler->Build(flux, points.front().first, points.back().first, nBins, true);
+
+  CRD_INFO(Generator, "[SpectrumSampler] Loaded " << points.size() << " points from " << fileName
+         << " (" << points.front().first / MeV << " - " << points.back().first / MeV
+         << " MeV)");
+
+  spectrumCache[fileName] = sampler;
+  return sampler;
+}
+
+G4double SpectrumSampler::Sample() const
+{
+  const G4int nBins = fProb.size();
+  G4double u = G4UniformRand() * nBins;
+  G4int bin = std::min(static_cast<G4int>(u), nBins - 1);
+  if (u - bin >= fProb[bin]) bin = fAlias[bin];
+  G4double x = fLo + (bin + G4UniformRand()) * fBinWidth;
+  return fLogBins ? std::exp(x) : x;
+}
+
+}  // namespace B1
@@ -0,0 +1,63 @@
+// Stacking action: optical photons that are not worth tracking
+// Yale Cubesat
+
+#include "StackingAction.hh"
+
+#include "BoxTracer.hh"
+#include "EarlyDecision.hh"
+#include "OpticalGovernor.hh"
+#include "ScintillatorResponse.hh"
+
+#include "G4OpticalPhoton.hh"
+#include "G4StackManager.hh"
+#include "G4Track.hh"
+
+namespace B1
+{
+
+G4ClassificationOfNewTrack StackingAction::ClassifyNewTrack(const G4Track* track)
+{
+  if (track->GetDefinition() != G4OpticalPhoton::OpticalPhotonDefinition()) return fUrgent;
+
+  // The parameterised response already made their photoelectrons
+  if (track->GetParentID() > 0 && ScintillatorResponse::Instance()->IsLive()) return fKill;
+
+  auto* governor = OpticalGovernor::Instance();
+  if (governor->IsActive() && !governor->AcceptNew(track)) return fKill;
+
+  auto* tracer = BoxTracer::Instance();
+  if (tracer->GetMode() != BoxTracer::Mode::Off && tracer->Take(track)) return fKill;
+
+  auto* early = EarlyDecision::Instance();
+  return early->IsEnabled() ? early->ClassifyPhoton() : fUrgent;
+}
+
+void StackingAction::NewStage()
+{
+  // The box tracer's photons are detected before the SiPM count is looked at
+  BoxTracer::Instance()->Flush();
+
+  // On a decision the batch just moved to the urgent stack is the probe,
+  // the waiting ones are dropped
+  auto* early = EarlyDecision::Instance();
+  if (early->IsEnabled()
+      && early->NewStage(stackManager->GetNTotalTrack(), stackManager->GetNUrgentTrack()))
+  {
+    for (G4int i = 0; i <= fAdditionalStacks; i++) stackManager->ClearWaitingStack(i);
+  }
+}
+
+void StackingAction::PrepareNewEvent()
+{
+  // One waiting stack per batch beyond the first, while the stacks are empty
+  auto* early = EarlyDecision::Instance();
+  const G4int needed = early->IsEnabled() ? early->GetBatches() - 1 : 0;
+  if (needed > fAdditionalStacks) {
+    stackManager->SetNumberOfAdditionalWaitingStacks(needed);
+    fAdditionalStacks = needed;
+  }
+  early->BeginOfEvent();
+  BoxTracer::Instance()->BeginOfEvent();
+}
+
+}  // namespace B1
@@ -30,11 +30,17 @@
 #include "SteppingAction.hh"
 #include "EventAction.hh"
 #include "DetectorConstruction.hh"
+#include "DepositReplay.hh"
+#include "OpticalGovernor.hh"
+#include "OpticalLUT.hh"
+#include "OutputThread.hh"
+#include "ScintillatorResponse.hh"
 
 #include "G4Step.hh"
 #include "G4RunManager.hh"
 #include "G4LogicalVolume.hh"
 #include "G4SystemOfUnits.hh"
+#include "G4OpticalPhoton.hh"
 
 namespace B1
 {
@@ -52,26 +58,59 @@ void SteppingAction::UserSteppingAction(const G4Step* step)
         fScoringVolume = detConstruction->GetScoringVolume();
     }
 
+    // Optical photon governor, in every volume
+    auto* governor = OpticalGovernor::Instance();
+    if (step->GetTrack()->GetDefinition() == G4OpticalPhoton::OpticalPhotonDefinition()) {
+        if (governor->IsActive()) governor->Step(step);
+    }
+    else if (governor->GetYieldFactor() > 1. && !ScintillatorResponse::Instance()->IsLive()) {
+        governor->Scintillate(step);
+    }
+
     G4LogicalVolume* volume =
         step->GetPreStepPoint()->GetTouchableHandle()->GetVolume()->GetLogicalVolume();
 
     if (volume != fScoringVolume) return;
 
+    // Parameterised response, or light-collection map calibration / lookup
+    auto* response = ScintillatorResponse::Instance();
+    auto* opticalLUT = OpticalLUT::Instance();
+    if (response->IsLive()) {
+        response->Convert(step);
+    }
+    else if (opticalLUT->GetMode() == OpticalLUT::Mode::Calibrate) {
+        const G4Track* track = step->GetTrack();
+        if (track->GetCurrentStepNumber() == 1 &&
+            track->GetDefinition() == G4OpticalPhoton::OpticalPhotonDefinition()) {
+            opticalLUT->RecordEmission(track);
+        }
+    }
+    else if (opticalLUT->GetMode() == OpticalLUT::Mode::Lookup) {
+        opticalLUT->GenerateHits(step);
+    }
+
+    if (step->GetTrack()->GetTrackID() == 1) {
+        fEventAction->SetPrimaryEntry(step->GetPreStepPoint()->GetPosition());
+    }
+
     G4double edepStep = step->GetTotalEnergyDeposit();
     fEventAction->AddEdep(edepStep);  // thread-local per event
 
-    auto pos  = step->GetPreStepPoint()->GetPosition();
-    auto time = step->GetPreStepPoint()->GetGlobalTime();
-
-    std::tuple<G4double,G4double,G4double,G4double,G4double> hit{
-        pos.x()/CLHEP::mm,
-        pos.y()/CLHEP::mm,
-        pos.z()/CLHEP::mm,
-        time/CLHEP::ns,
-        edepStep/CLHEP::eV
-    };
+    // Step hits only with a deposit, and only when they are written out
+    const auto* preStep = step->GetPreStepPoint();
+    if (edepStep > 0. && OutputThread::Instance()->GetRecordStepHits()) {
+        fEventAction->AddStepHit(preStep->GetPosition(), preStep->GetGlobalTime(), edepStep,
+                                 preStep->GetTouchableHandle()->GetCopyNumber(),
+                                 step->GetTrack()->GetTrackID());
+    }
 
-    fEventAction->AddStepHit(hit);
+    // Record pass: the deposit at the step midpoint, for the optical replay
+    if (edepStep > 0. && DepositReplay::Instance()->GetMode() == DepositReplay::Mode::Record) {
+        const auto* postStep = step->GetPostStepPoint();
+        fEventAction->AddDeposit(0.5 * (preStep->GetPosition() + postStep->GetPosition()),
+                                 0.5 * (preStep->GetGlobalTime() + postStep->GetGlobalTime()),
+                                 edepStep, step->GetTrack()->GetDefinition()->GetPDGEncoding());
+    }
 }
 
 } // namespace B1
@@ -0,0 +1,133 @@
+// Per-event trigger deciding what gets written
+// Yale Cubesat
+
+#include "Trigger.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+
+namespace B1
+{
+
+Trigger* Trigger::Instance()
+{
+  static Trigger* instance = new Trigger();
+  return instance;
+}
+
+Trigger::Trigger()
+{
+  DefineCommands();
+}
+
+void Trigger::DefineCommands()
+{
+  // Read by the workers at the end of each event, so nothing is broadcast
+  fMessenger = new G4GenericMessenger(this, "/crd/trigger/", "Event trigger");
+
+  auto& photonsCmd = fMessenger->DeclareProperty("photons", fPhotons,
+                                                 "Detected photons needed within the "
+                                                 "window; 0 turns the condition off.");
+  photonsCmd.SetParameterName("photons", false);
+  photonsCmd.SetRange("photons>=0");
+  photonsCmd.SetStates(G4State_PreInit, G4State_Idle);
+  photonsCmd.SetToBeBroadcasted(false);
+
+  auto& windowCmd = fMessenger->DeclarePropertyWithUnit("window", "ns", fWindow,
+                                                        "Coincidence window of the photon "
+                                                        "condition; 0 for the whole event.");
+  windowCmd.SetParameterName("window", false);
+  windowCmd.SetRange("window>=0.");
+  windowCmd.SetStates(G4State_PreInit, G4State_Idle);
+  windowCmd.SetToBeBroadcasted(false);
+
+  auto& edepCmd = fMessenger->DeclarePropertyWithUnit("edep", "MeV", fEdep,
+                                                      "Scintillator energy deposit needed; "
+                                                      "0 turns the condition off.");
+  edepCmd.SetParameterName("edep", false);
+  edepCmd.SetRange("edep>=0.");
+  edepCmd.SetStates(G4State_PreInit, G4State_Idle);
+  edepCmd.SetToBeBroadcasted(false);
+
+  auto& logicCmd = fMessenger->DeclareMethod("logic", &Trigger::SetLogic,
+                                             "any: one condition is enough. "
+                                             "all: every condition that is on.");
+  logicCmd.SetParameterName("logic", false);
+  logicCmd.SetCandidates("any all");
+  logicCmd.SetStates(G4State_PreInit, G4State_Idle);
+  logicCmd.SetToBeBroadcasted(false);
+
+  auto& persistCmd = fMessenger->DeclareMethod("persist", &Trigger::SetPersist,
+                                               "triggered: write only accepted events. "
+                                               "all: write every event, with its "
+                                               "trigger flag.");
+  persistCmd.SetParameterName("events", false);
+  persistCmd.SetCandidates("triggered all");
+  persistCmd.SetStates(G4State_PreInit, G4State_Idle);
+  persistCmd.SetToBeBroadcasted(false);
+}
+
+void Trigger::SetLogic(const G4String& logic)
+{
+  fRequireAll = (logic == "all");
+}
+
+void Trigger::SetPersist(const G4String& persist)
+{
+  fPersistAll = (persist == "all");
+}
+
+template <typename PhotonTest>
+G4bool Trigger::Decide(G4double edep, PhotonTest photonsPass) const
+{
+  // The photon test can mean sorting the arrival times, so it goes last
+  const G4bool usePhotons = fPhotons > 0;
+  const G4bool useEdep = fEdep > 0.;
+  if (!usePhotons && !useEdep) return true;
+  const G4bool edepPass = useEdep && edep >= fEdep;
+  if (fRequireAll) return (!useEdep || edepPass) && (!usePhotons || photonsPass());
+  return edepPass || (usePhotons && photonsPass());
+}
+
+G4bool Trigger::Accept(G4double edep, const SiPMHitsCollection* hits,
+                       std::vector<float>& times) const
+{
+  return Decide(edep, [&]() {
+    const G4int n = hits ? hits->entries() : 0;
+    if (n < fPhotons) return false;
+    if (fWindow <= 0.) return true;
+
+    times.clear();
+    for (G4int i = 0; i < n; i++) times.push_back((*hits)[i]->GetTime() / ns);
+    std::sort(times.begin(), times.end());
+    const float window = fWindow / ns;
+    for (G4int first = 0, last = fPhotons - 1; last < n; first++, last++) {
+      if (times[last] - times[first] <= window) return true;
+    }
+    return false;
+  });
+}
+
+G4bool Trigger::Accept(G4double edep, const TimeHistogram& histogram,
+                       SparseTimeHistogram& bins) const
+{
+  return Decide(edep, [&]() {
+    if (histogram.GetTotal() < fPhotons) return false;
+    if (fWindow <= 0.) return true;
+
+    // Photons outside the histogram window cannot be placed in time
+    histogram.GetNonZero(bins.bin, bins.count);
+    const G4int span = static_cast<G4int>(fWindow / histogram.GetBinWidth());
+    G4int inWindow = 0;
+    for (size_t first = 0, last = 0; last < bins.bin.size(); last++) {
+      inWindow += bins.count[last];
+      while (bins.bin[last] - bins.bin[first] > span) inWindow -= bins.count[first++];
+      if (inWindow >= fPhotons) return true;
+    }
+    return false;
+  });
+}
+
+}  // namespace B1
@@ -0,0 +1,207 @@
+// Sampled SiPM waveforms
+// Yale Cubesat
+
+#include "WaveformWriter.hh"
+
+#include "G4SystemOfUnits.hh"
+#include "Log.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <utility>
+
+namespace B1
+{
+
+void WaveformWriter::Open(const WaveformSettings& settings)
+{
+  fPeriod = settings.period;
+  fSamples = settings.samples;
+  fBatch = settings.batch;
+  fCount = 0;
+  fGroups = 0;
+
+  // The pulse is cut at the window length: later samples cannot reach
+  // into it. With FFT size >= samples + pulse - 1 nothing wraps round.
+  std::vector<G4double> pulse;
+  BuildPulse(settings, pulse);
+  fFFT = std::make_unique<FFT>(fSamples + pulse.size() - 1);
+  const std::size_t size = fFFT->Size();
+  fPulseSpectrum.assign(size, 0.);
+  for (std::size_t i = 0; i < pulse.size(); i++) fPulseSpectrum[i] = pulse[i] / size;
+  fFFT->Forward(fPulseSpectrum.data());
+
+  fWork.resize((fBatch + 1) / 2 * size);
+  fTrains.clear();
+  fTrains.reserve(static_cast<std::size_t>(fBatch) * fSamples);
+
+  fFile.open("waveforms.crdh", std::ios::binary | std::ios::trunc);
+  if (!fFile.is_open()) {
+    G4Exception("WaveformWriter::Open()", "Output004", JustWarning,
+                "Cannot open waveforms.crdh, waveforms will not be written.");
+    return;
+  }
+  WriteHeader();  // counts filled in by Close()
+
+  CRD_INFO(Run, "[WaveformWriter] " << fSamples << " samples of " << fPeriod / ns
+         << " ns, " << pulse.size() << "-sample pulse, FFT size " << size);
+}
+
+void WaveformWriter::BuildPulse(const WaveformSettings& settings,
+                                std::vector<G4double>& pulse) const
+{
+  pulse.clear();
+  if (!settings.speFile.empty() && settings.speFile != "none"
+      && ReadPulse(settings.speFile, pulse)) {
+    G4double peak = *std::max_element(pulse.begin(), pulse.end());
+    if (peak > 0.) {
+      for (auto& value : pulse) value *= settings.speAmplitude / peak;
+      return;
+    }
+    G4Exception("WaveformWriter::BuildPulse()", "Output005", JustWarning,
+                "Single-p.e. pulse file has no positive amplitude, using the "
+                "two-exponential pulse.");
+    pulse.clear();
+  }
+
+  // exp(-t / fall) - exp(-t / rise), scaled to its peak, until it has
+  // decayed to 1e-4 of it
+  const G4double rise = settings.riseTime;
+  const G4double fall = std::max(settings.fallTime, 1.001 * rise);
+  const G4double tPeak = rise * fall / (fall - rise) * std::log(fall / rise);
+  const G4double peak = std::exp(-tPeak / fall) - std::exp(-tPeak / rise);
+  for (G4int i = 0; i < fSamples; i++) {
+    const G4double t = i * fPeriod;
+    const G4double value = (std::exp(-t / fall) - std::exp(-t / rise)) / peak;
+    if (t > tPeak && value < 1e-4) break;
+    pulse.push_back(settings.speAmplitude * value);
+  }
+  if (pulse.empty()) pulse.push_back(0.);
+}
+
+G4bool WaveformWriter::ReadPulse(const G4String& fileName, std::vector<G4double>& pulse) const
+{
+  std::ifstream in(fileName);
+  if (!in.is_open()) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open single-p.e. pulse file " << fileName
+        << ", using the two-exponential pulse.";
+    G4Exception("WaveformWriter::ReadPulse()", "Output005", JustWarning, msg);
+    return false;
+  }
+
+  // Rows are "time [ns], amplitude"; anything that does not parse is skipped
+  std::vector<std::pair<G4double, G4double>> points;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::istringstream fields(line);
+    G4double time = 0., amplitude = 0.;
+    if (fields >> time >> amplitude) points.emplace_back(time * ns, amplitude);
+  }
+  std::sort(points.begin(), points.end());
+  if (points.size() < 2) {
+    G4ExceptionDescription msg;
+    msg << "Single-p.e. pulse file " << fileName << " has fewer than two usable rows, "
+        << "using the two-exponential pulse.";
+    G4Exception("WaveformWriter::ReadPulse()", "Output005", JustWarning, msg);
+    return false;
+  }
+
+  // Resampled from the first row onwards, linear in between
+  const G4double t0 = points.front().first;
+  std::size_t j = 0;
+  for (G4int i = 0; i < fSamples; i++) {
+    const G4double t = t0 + i * fPeriod;
+    if (t > points.back().first) break;
+    while (points[j + 1].first < t) j++;
+    const auto& [ta, a] = points[j];
+    const auto& [tb, b] = points[j + 1];
+    pulse.push_back(tb > ta ? a + (b - a) * (t - ta) / (tb - ta) : a);
+  }
+  return true;
+}
+
+void WaveformWriter::WriteHeader()
+{
+  const float period = fPeriod / ns;
+  const std::int32_t samples = fSamples;
+  const std::int64_t sizes[2] = {fCount, fGroups};
+  fFile.write("CRDWAV01", 8);
+  fFile.write(reinterpret_cast<const char*>(&period), sizeof(period));
+  fFile.write(reinterpret_cast<const char*>(&samples), sizeof(samples));
+  fFile.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+}
+
+void WaveformWriter::Add(const std::vector<float>& train, G4int eventID, G4int thread)
+{
+  if (!fFile.is_open()) return;
+
+  fEvent.push_back(eventID);
+  fThread.push_back(thread);
+  const std::size_t n = std::min<std::size_t>(train.size(), fSamples);
+  fTrains.insert(fTrains.end(), train.begin(), train.begin() + n);
+  fTrains.resize(fEvent.size() * fSamples, 0.f);
+
+  if (static_cast<G4int>(fEvent.size()) >= fBatch) WriteBatch();
+}
+
+void WaveformWriter::WriteBatch()
+{
+  const std::size_t rows = fEvent.size();
+  if (rows == 0) return;
+
+  // Trains 2p and 2p + 1 go into transform p as real and imaginary parts
+  const std::size_t size = fFFT->Size();
+  const std::size_t transforms = (rows + 1) / 2;
+  std::fill(fWork.begin(), fWork.begin() + transforms * size, 0.);
+  for (std::size_t row = 0; row < rows; row++) {
+    const float* train = &fTrains[row * fSamples];
+    auto* work = &fWork[row / 2 * size];
+    for (G4int i = 0; i < fSamples; i++) {
+      if (row % 2 == 0)
+        work[i].real(train[i]);
+      else
+        work[i].imag(train[i]);
+    }
+  }
+
+  fFFT->Forward(fWork.data(), transforms);
+  for (std::size_t t = 0; t < transforms; t++) {
+    auto* work = &fWork[t * size];
+    for (std::size_t k = 0; k < size; k++) work[k] *= fPulseSpectrum[k];
+  }
+  fFFT->Inverse(fWork.data(), transforms);
+
+  // Waveforms overwrite the trains they came from
+  for (std::size_t row = 0; row < rows; row++) {
+    float* waveform = &fTrains[row * fSamples];
+    const auto* work = &fWork[row / 2 * size];
+    for (G4int i = 0; i < fSamples; i++)
+      waveform[i] = row % 2 == 0 ? work[i].real() : work[i].imag();
+  }
+
+  const std::int32_t header[2] = {static_cast<std::int32_t>(rows), 0};
+  fFile.write(reinterpret_cast<const char*>(header), sizeof(header));
+  fFile.write(reinterpret_cast<const char*>(fEvent.data()), rows * sizeof(std::int32_t));
+  fFile.write(reinterpret_cast<const char*>(fThread.data()), rows * sizeof(std::int32_t));
+  fFile.write(reinterpret_cast<const char*>(fTrains.data()), fTrains.size() * sizeof(float));
+  fCount += rows;
+  fGroups++;
+
+  fEvent.clear();
+  fThread.clear();
+  fTrains.clear();
+}
+
+void WaveformWriter::Close()
+{
+  if (!fFile.is_open()) return;
+  WriteBatch();
+  fFile.seekp(0);
+  WriteHeader();
+  fFile.close();
+}
+
+}  // namespace B1